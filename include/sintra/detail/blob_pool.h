@@ -0,0 +1,331 @@
+/*
+Copyright 2017 Ioannis Makris
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SINTRA_BLOB_POOL_H
+#define SINTRA_BLOB_POOL_H
+
+
+#include "config.h"
+#include "id_types.h"
+#include "ipc_rings.h"
+#include "spinlock.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+
+namespace sintra {
+
+
+using std::atomic;
+using std::string;
+using std::vector;
+
+
+/*
+
+Variable buffers that exceed blob_spill_threshold are not copied into the ring. Their payload
+is written once to a shared memory region owned by the sending process (its blob pool), and
+the message only carries a descriptor. This lifts the octile limit of the ring for large
+payloads, and avoids copying them again when the coordinator relays the message.
+
+1. Each process owns a single pool, which it maps read-write and is the only one to allocate
+   from. Readers attach to the pools of other processes lazily, the first time they encounter
+   one of their blobs.
+
+2. The pool is divided into chunks of blob_chunk_size. A blob occupies a contiguous run of
+   chunks and starts with a Blob_header. Offsets are relative to the beginning of the region,
+   and since the first chunk holds the control data, an offset of 0 is never a valid blob.
+
+3. The blobs of a message are chained through their headers, starting from
+   Message_prefix::blob_chain. This allows a relaying ring to reference them without knowing
+   the type of the message.
+
+4. Blobs are reference counted. Every ring carrying a descriptor of a blob holds a reference,
+   which is dropped once the writer of that ring overwrites the descriptor. By then, the ring
+   guarantees that no reader is accessing it. Readers may take additional references, to
+   extend the lifetime of a payload beyond the dispatch of its message.
+
+5. Blobs whose reference count has dropped to zero are reclaimed lazily by the owner, once
+   an allocation does not fit in the free chunks.
+
+*/
+
+
+class blob_pool_acquisition_failure_exception {};
+
+
+struct Blob_pool
+{
+    struct Control
+    {
+        // This struct is instantiated in the first chunk of the shared region.
+        atomic<size_t>                  num_attached        = 0;
+    };
+
+
+    struct Blob_header
+    {
+        atomic<uint32_t>                refcount;
+        uint32_t                        num_chunks;
+        uint64_t                        num_bytes;
+
+        // offset of the next blob of the same message, or 0 if this is the last one
+        uint64_t                        next;
+
+        // keeps the payload aligned to 64 bytes
+        uint64_t                        reserved[5];
+    };
+
+
+    static_assert(sizeof(Control) <= blob_chunk_size, "blob_chunk_size is too small");
+    static_assert(blob_pool_size % blob_chunk_size == 0, "invalid blob pool configuration");
+
+
+    Blob_pool(const string& directory, instance_id_type owner_id, bool owner):
+        m_owner(owner)
+    {
+        m_filename = directory + "/" + get_filename(owner_id);
+
+        if ((m_owner && !create()) || !attach()) {
+            throw blob_pool_acquisition_failure_exception();
+        }
+
+        if (m_owner) {
+            new (m_control) Control;
+            m_chunk_used.assign(blob_pool_size / blob_chunk_size, false);
+            m_chunk_used[0] = true;
+            m_cursor = 1;
+        }
+
+        m_control->num_attached++;
+    }
+
+
+    ~Blob_pool()
+    {
+        bool remove_file = m_control->num_attached-- == 1;
+
+        delete m_region;
+        m_region = nullptr;
+        m_control = nullptr;
+
+        if (remove_file) {
+            error_code ec;
+            remove(fs::path(m_filename), ec);
+        }
+    }
+
+
+    Blob_pool(const Blob_pool&) = delete;
+    const Blob_pool& operator = (const Blob_pool&) = delete;
+
+
+    // Allocates a blob with a reference count of 1, for the ring that will carry its
+    // descriptor. Returns 0 if there is not enough space. Only the owner may allocate.
+    uint64_t allocate(size_t num_bytes)
+    {
+        assert(m_owner);
+
+        size_t num_chunks = (sizeof(Blob_header) + num_bytes + blob_chunk_size - 1) / blob_chunk_size;
+
+        spinlock::locker l(m_allocation_lock);
+
+        size_t first = find_free_chunks(num_chunks);
+        if (!first) {
+            reclaim();
+            first = find_free_chunks(num_chunks);
+            if (!first) {
+                return 0;
+            }
+        }
+
+        for (size_t i = first; i < first + num_chunks; i++) {
+            m_chunk_used[i] = true;
+        }
+        m_cursor = first + num_chunks;
+
+        uint64_t offset = first * blob_chunk_size;
+        auto& h = header(offset);
+        h.refcount      = 1;
+        h.num_chunks    = (uint32_t)num_chunks;
+        h.num_bytes     = num_bytes;
+        h.next          = 0;
+
+        m_live_blobs.push_back(offset);
+        return offset;
+    }
+
+
+    void add_ref(uint64_t offset)       { header(offset).refcount++; }
+    void release(uint64_t offset)       { header(offset).refcount--; }
+
+
+    // The following two operate on all the blobs of a message
+    void add_ref_chain(uint64_t offset)
+    {
+        for (; offset; offset = header(offset).next) {
+            add_ref(offset);
+        }
+    }
+
+    void release_chain(uint64_t offset)
+    {
+        while (offset) {
+            // the header may not be accessed after it is released
+            auto next = header(offset).next;
+            release(offset);
+            offset = next;
+        }
+    }
+
+
+    Blob_header& header(uint64_t offset) const
+    {
+        assert(offset && offset < blob_pool_size && offset % blob_chunk_size == 0);
+        return *(Blob_header*)(m_base + offset);
+    }
+
+
+    char* data(uint64_t offset) const
+    {
+        return (char*)&header(offset) + sizeof(Blob_header);
+    }
+
+
+    static string get_filename(instance_id_type owner_id)
+    {
+        std::stringstream stream;
+        stream << std::hex << owner_id;
+        return "blob_" + stream.str();
+    }
+
+
+private:
+
+    bool create()
+    {
+        try {
+            ipc::file_handle_t fh =
+                ipc::ipcdetail::create_new_file(m_filename.c_str(), ipc::read_write);
+            if (fh == ipc::ipcdetail::invalid_file())
+                return false;
+
+            // The file is sparse on most systems, thus unused chunks do not occupy any storage.
+            if (!ipc::ipcdetail::truncate_file(fh, blob_pool_size))
+                return false;
+
+            return ipc::ipcdetail::close_file(fh);
+        }
+        catch (...) {
+        }
+        return false;
+    }
+
+
+    bool attach()
+    {
+        try {
+            if (fs::file_size(m_filename) != blob_pool_size) {
+                return false;
+            }
+
+            ipc::file_mapping file(m_filename.c_str(), ipc::read_write);
+            m_region = new ipc::mapped_region(file, ipc::read_write, 0, blob_pool_size);
+            m_base = (char*)m_region->get_address();
+            m_control = (Control*)m_base;
+            return true;
+        }
+        catch (...) {
+            return false;
+        }
+    }
+
+
+    // Returns the index of the first of num_chunks consecutive free chunks, or 0 if there are
+    // not any. The search starts from the end of the last allocation, to reduce fragmentation
+    // and to give readers holding references to recent blobs some time to release them.
+    size_t find_free_chunks(size_t num_chunks) const
+    {
+        auto scan = [&](size_t begin, size_t end) -> size_t {
+            size_t run = 0;
+            for (size_t i = begin; i < end; i++) {
+                run = m_chunk_used[i] ? 0 : run + 1;
+                if (run == num_chunks) {
+                    return i + 1 - num_chunks;
+                }
+            }
+            return 0;
+        };
+
+        size_t total = m_chunk_used.size();
+        size_t ret = scan(m_cursor, total);
+        return ret ? ret : scan(1, std::min(total, m_cursor + num_chunks - 1));
+    }
+
+
+    // Frees the chunks of all blobs that are no longer referenced.
+    void reclaim()
+    {
+        for (size_t i = 0; i < m_live_blobs.size(); ) {
+            auto& h = header(m_live_blobs[i]);
+            if (h.refcount.load() == 0) {
+                size_t first = m_live_blobs[i] / blob_chunk_size;
+                for (size_t j = first; j < first + h.num_chunks; j++) {
+                    m_chunk_used[j] = false;
+                }
+                m_live_blobs[i] = m_live_blobs.back();
+                m_live_blobs.pop_back();
+            }
+            else {
+                i++;
+            }
+        }
+    }
+
+
+    const bool                          m_owner;
+    string                              m_filename;
+    ipc::mapped_region*                 m_region            = nullptr;
+    char*                               m_base              = nullptr;
+    Control*                            m_control           = nullptr;
+
+    // allocator state, only relevant to the owner
+    spinlock                            m_allocation_lock;
+    vector<bool>                        m_chunk_used;
+    vector<uint64_t>                    m_live_blobs;
+    size_t                              m_cursor            = 0;
+};
+
+
+} // namespace sintra
+
+
+#endif
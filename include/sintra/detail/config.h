@@ -27,6 +27,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define SINTRA_CONFIG_H
 
 
+#include <cstddef>
+#include <cstdint>
+
+
 // Ring reading policies
 // =====================
 
@@ -89,6 +93,42 @@ namespace sintra {
 	// should not cause cache invalidations (false sharing). This setting is architecture specific,
 	// but it's not really that different among different x86 CPUs.
     constexpr size_t assumed_cache_line_size                = 0x40;
+
+    // Variable buffers of at least this size are not copied into the ring. Their payload is
+    // written to the blob pool of the sending process, and the message only carries a
+    // descriptor. See blob_pool.h
+    constexpr size_t    blob_spill_threshold                = 0x4000;    // bytes
+
+    // Messages of at least this size are relayed by the coordinator by reference, i.e. readers
+    // read them from the ring of the process that sent them, rather than from a copy in the
+    // ring of the coordinator. Payloads of blob_spill_threshold or more are never copied into
+    // the rings to begin with. See Message_ring_W::relay_by_reference()
+    constexpr size_t    relay_by_reference_threshold        = 0x400;     // bytes
+
+    // The size of the shared memory region of the blob pool of each process, and the
+    // granularity of its allocations.
+    constexpr size_t    blob_pool_size                      = 0x4000000; // bytes
+    constexpr size_t    blob_chunk_size                     = 0x1000;    // bytes
+
+    // The maximum number of messages that may be retained (pinned in the ring, to be processed
+    // after their handler returns) by each ring reader. A retained message prevents the writer
+    // from proceeding beyond its octile, thus keeping this small protects the writer.
+    constexpr int       max_retained_messages               = 32;
+
+    // The number of items of a streamed RPC result (see rpc_stream.h) the callee may write
+    // ahead of the caller, i.e. that may be in the rings or queued by the caller at any time.
+    // The caller grants more, half of this at a time, as it consumes them.
+    constexpr uint32_t  rpc_stream_window                   = 64;
+
+    // The size of the swarm-wide shared arena, and the address at which every process tries
+    // to map it. Raw pointers into the arena (such as those held by std::pmr containers) are
+    // only valid among processes that managed to map it at this address. See shared_arena.h
+    constexpr size_t    shared_arena_size                   = 0x10000000; // bytes
+#if INTPTR_MAX == INT64_MAX
+    constexpr uintptr_t shared_arena_address                = 0x600000000000;
+#else
+    constexpr uintptr_t shared_arena_address                = 0;
+#endif
 }
 
 
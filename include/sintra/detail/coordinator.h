@@ -56,25 +56,18 @@ struct Process_group: Derived_transceiver<Process_group>
 
     void set(const unordered_set<instance_id_type>& member_process_ids);
 
-    // barriers are deferred functions and return twice (this refers to the implementation,
-    // which is transparent to the caller - for the caller they only return once).
-    // the first returns 0 if it is expected to fail, or a serial number, if it is expected
-    // to succeed.
-    // once completed, a message is sent, that should be picked up and read only by the
-    // processes waiting on the barrier. This message would contain
-    // - the serial number, for identification purposes
-    // - the sequence counter (i.e. at which ring sequence was the barrier completed)
-    sequence_counter_type barrier(const string& barrier_name);
+    // Barriers return deferred results, which are completed by the last process to arrive,
+    // with the leading sequence of the coordinator process' request ring at that point.
+    // This is transparent to the callers, which simply block until then.
+    deferred<sequence_counter_type> barrier(const string& barrier_name);
 
 
     struct Barrier
     {
-        mutex                                   m;
-        condition_variable                      cv;
         unordered_set<instance_id_type>         processes_pending;
         //sequence_counter_type                   flush_sequence = 0;
         bool                                    failed = false;
-        instance_id_type                        common_function_iid = invalid_instance_id;
+        vector<deferred<sequence_counter_type>> waiting;
     };
 
     unordered_map<string, Barrier>              m_barriers;
@@ -124,7 +117,7 @@ private:
     type_id_type resolve_type(const string& pretty_name);
     instance_id_type resolve_instance(const string& assigned_name);
 
-    instance_id_type wait_for_instance(const string& assigned_name);
+    deferred<instance_id_type> wait_for_instance(const string& assigned_name);
 
     instance_id_type publish_transceiver(
         type_id_type type_id, instance_id_type instance_id, const string& assigned_name);
@@ -148,6 +141,9 @@ private:
 
     void print(const string& str);
 
+    // The published instances of the specified type, across the swarm.
+    vector<instance_id_type> instances_of_type(type_id_type type_id);
+
 
     mutex                                       m_publish_mutex;
     mutex                                       m_groups_mutex;
@@ -173,9 +169,8 @@ private:
     // (currently, only inside publish_transceiver() )
     map<
         string,
-        unordered_set<instance_id_type>
+        vector<deferred<instance_id_type>>
     >                                           m_instances_waited;
-    map<string, instance_id_type>               m_instances_waited_common_iids;
 
 public:
     SINTRA_RPC_EXPLICIT(resolve_type)  
@@ -185,6 +180,7 @@ public:
     SINTRA_RPC_EXPLICIT(unpublish_transceiver)
     SINTRA_RPC_EXPLICIT(make_process_group)
     SINTRA_RPC_EXPLICIT(print)
+    SINTRA_RPC_EXPLICIT(instances_of_type)
 
     SINTRA_SIGNAL_EXPLICIT(instance_published,
         type_id_type type_id, instance_id_type instance_id, message_string assigned_name)
@@ -47,7 +47,7 @@ using std::unique_lock;
 
 
 // EXPORTED EXCLUSIVELY FOR RPC
-sequence_counter_type Process_group::barrier(
+deferred<sequence_counter_type> Process_group::barrier(
     const string& barrier_name)
 {
     std::unique_lock basic_lock(m_call_mutex);
@@ -57,41 +57,31 @@ sequence_counter_type Process_group::barrier(
     }
 
     Barrier& b = m_barriers[barrier_name];
-    b.m.lock(); // main barrier lock
-    basic_lock.unlock();
     
     if (b.processes_pending.empty()) {
         // new or reused barrier (may have failed previously)
         b.processes_pending = m_process_ids;
         b.failed = false;
-        b.common_function_iid = make_instance_id();
+        b.waiting.clear();
     }
 
     b.processes_pending.erase(caller_piid);
 
     if (b.processes_pending.size() == 0) {
-        auto additional_pids = m_process_ids;
-        additional_pids.erase(caller_piid);
-
-        assert(s_tl_common_function_iid == invalid_instance_id);
-        assert(s_tl_additional_piids_size == 0);
-        assert(additional_pids.size() < max_process_index);
-        s_tl_additional_piids_size = 0;
-        for (auto& e : additional_pids) {
-            s_tl_additional_piids[s_tl_additional_piids_size++] = e;
-        }
-
-        s_tl_common_function_iid = b.common_function_iid;
-        b.m.unlock();
+        auto waiting = std::move(b.waiting);
         m_barriers.erase(barrier_name);
-        return s_mproc->m_out_req_c->get_leading_sequence();
-    }
-    else {
-        std::pair<deferral, function<void()> > ret;
-        ret.first.new_fiid = b.common_function_iid;
-        ret.second = [&](){ b.m.unlock(); };
-        throw ret;
+        basic_lock.unlock();
+
+        auto sequence = s_mproc->m_out_req_c->get_leading_sequence();
+        for (auto& w : waiting) {
+            w.complete(sequence);
+        }
+        return sequence;
     }
+
+    auto ret = make_deferred<sequence_counter_type>();
+    b.waiting.push_back(ret);
+    return ret;
 }
 
 
@@ -150,7 +140,7 @@ instance_id_type Coordinator::resolve_instance(const string& assigned_name)
 
 
 // EXPORTED EXCLUSIVELY FOR RPC
-instance_id_type Coordinator::wait_for_instance(const string& assigned_name)
+deferred<instance_id_type> Coordinator::wait_for_instance(const string& assigned_name)
 {
     // This works similarly to a barrier. The difference is that
     // a barrier operates in a defined set of process instances, whereas
@@ -161,32 +151,17 @@ instance_id_type Coordinator::wait_for_instance(const string& assigned_name)
     // the instance, thus using it for synchronization may not always be
     // applicable.
 
-    m_publish_mutex.lock();
-    instance_id_type caller_piid = s_tl_current_message->sender_instance_id;
+    lock_guard<mutex> lock(m_publish_mutex);
 
     auto iid = resolve_instance(assigned_name);
     if (iid != invalid_instance_id) {
-        m_publish_mutex.unlock();
         return iid;
     }
 
-    m_instances_waited[assigned_name].insert(caller_piid);
-
-    instance_id_type common_function_iid;
-    auto it = m_instances_waited_common_iids.find(assigned_name);
-    if (it != m_instances_waited_common_iids.end()) {
-        common_function_iid = it->second;
-    }
-    else {
-        common_function_iid = m_instances_waited_common_iids[assigned_name] = make_instance_id();
-    }
-
-    std::pair<deferral, std::function<void()>> ret;
-    ret.first.new_fiid = common_function_iid;
-    ret.second = [&](){
-        m_publish_mutex.unlock();
-    };
-    throw ret;
+    // completed by publish_transceiver()
+    auto ret = make_deferred<instance_id_type>();
+    m_instances_waited[assigned_name].push_back(ret);
+    return ret;
 }
 
 
@@ -208,19 +183,14 @@ instance_id_type Coordinator::publish_transceiver(type_id_type tid, instance_id_
 
     auto true_sequence = [&](){
         emit_global<instance_published>(tid, iid, assigned_name);
-        assert(s_tl_additional_piids_size == 0);
-        assert(s_tl_common_function_iid == invalid_instance_id);
-        assert(m_instances_waited[assigned_name].size() < max_process_index);
 
-        s_tl_additional_piids_size = 0;
-        for (auto& e : m_instances_waited[assigned_name]) {
-            s_tl_additional_piids[s_tl_additional_piids_size++] = e;
+        auto it = m_instances_waited.find(assigned_name);
+        if (it != m_instances_waited.end()) {
+            for (auto& w : it->second) {
+                w.complete(iid);
+            }
+            m_instances_waited.erase(it);
         }
-
-
-        s_tl_common_function_iid = m_instances_waited_common_iids[assigned_name];        
-        m_instances_waited.erase(assigned_name);
-        m_instances_waited_common_iids.erase(assigned_name);
         return iid;
     };
 
@@ -317,6 +287,11 @@ bool Coordinator::unpublish_transceiver(instance_id_type iid)
         // remove the unpublished process's registry entry
         m_transceiver_registry.erase(pr_it);
 
+        // and its interests, in case it did not exit cleanly
+        if (s_mproc->m_interest_map) {
+            s_mproc->m_interest_map->clear(process_iid);
+        }
+
         lock_guard<mutex> lock(m_groups_mutex);
 
         for (auto& group_entry : m_groups) {
@@ -379,6 +354,25 @@ void Coordinator::print(const string& str)
     cout << str;
 }
 
+
+
+// EXPORTED FOR RPC
+inline
+vector<instance_id_type> Coordinator::instances_of_type(type_id_type type_id)
+{
+    lock_guard<mutex> lock(m_publish_mutex);
+
+    vector<instance_id_type> ret;
+    for (auto& pr : m_transceiver_registry) {
+        for (auto& e : pr.second) {
+            if (e.second.type_id == type_id) {
+                ret.push_back(e.first);
+            }
+        }
+    }
+    return ret;
+}
+
 } // sintra
 
 
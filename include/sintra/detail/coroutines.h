@@ -0,0 +1,269 @@
+/*
+Copyright 2017 Ioannis Makris
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef SINTRA_COROUTINES_H
+#define SINTRA_COROUTINES_H
+
+
+// SINTRA_COROUTINES is defined in transceiver.h
+#ifdef SINTRA_COROUTINES
+
+
+#include "executor.h"
+#include "managed_process.h"
+#include "transceiver.h"
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+
+namespace sintra {
+
+
+using std::atomic;
+using std::coroutine_handle;
+using std::shared_ptr;
+
+
+/*
+
+With C++20, RPC calls and events may be awaited in coroutines, rather than blocking a thread.
+
+1. co_await rpc_co_<m>(instance, args...) makes the call (see rpc_async_<m>) once the coroutine
+   is suspended, and resumes it with the result, or throws the exception of the call.
+
+2. co_await next<MESSAGE_T>(sender) activates a slot, which is deactivated by the first message
+   of the type, sent by the specified sender. The coroutine is resumed with a shared pointer to
+   the message (see hold()).
+
+3. By default, the coroutine is resumed by the thread that completes it, which is either the
+   reply or the request reader. Since a reader that blocks cannot read anything else, the
+   coroutine should not make synchronous RPC calls before its next suspension. Alternatively,
+   it may be resumed on an executor, with on() (e.g. co_await rpc_co_f(i).on(pool)).
+
+4. Detached_task is a minimal coroutine type, for coroutines that nobody waits for. Exceptions
+   that escape such a coroutine terminate the program.
+
+*/
+
+
+namespace detail {
+
+// The states of an awaitable, whose completion may race with its suspension.
+enum Await_state: int
+{
+    AWAIT_STARTING,
+    AWAIT_SUSPENDED,
+    AWAIT_DONE
+};
+
+
+inline
+void resume_on(Executor* executor, coroutine_handle<> h)
+{
+    if (executor) {
+        executor->post([h]() { h.resume(); });
+    }
+    else {
+        h.resume();
+    }
+}
+
+} // namespace detail
+
+
+
+template <typename T>
+struct Rpc_awaitable
+{
+    using starter_type = function<void(Rpc_completion<T>)>;
+
+    explicit Rpc_awaitable(starter_type starter):
+        m_starter(std::move(starter))
+    {}
+
+    // Only valid before the awaitable is awaited.
+    Rpc_awaitable(Rpc_awaitable&& rhs):
+        m_starter(std::move(rhs.m_starter)),
+        m_executor(rhs.m_executor)
+    {}
+
+    // Resumes the coroutine on the specified executor, rather than on the reader thread.
+    Rpc_awaitable& on(Executor& executor) & { m_executor = &executor; return *this; }
+    Rpc_awaitable  on(Executor& executor) && { m_executor = &executor; return std::move(*this); }
+
+    bool await_ready() const { return false; }
+
+    bool await_suspend(coroutine_handle<> h)
+    {
+        m_handle = h;
+
+        Rpc_completion<T> completion;
+        if constexpr (std::is_void_v<T>) {
+            completion.on_return = [this]() { complete(); };
+        }
+        else {
+            completion.on_return = [this](T v) { m_result.emplace(std::move(v)); complete(); };
+        }
+        completion.on_failure = [this](std::exception_ptr e) { m_exception = e; complete(); };
+
+        try {
+            m_starter(std::move(completion));
+        }
+        catch (...) {
+            m_exception = std::current_exception();
+            return false;
+        }
+
+        // if the call completed before this, the coroutine is not suspended at all
+        int expected = detail::AWAIT_STARTING;
+        return m_state.compare_exchange_strong(expected, detail::AWAIT_SUSPENDED);
+    }
+
+    T await_resume()
+    {
+        if (m_exception) {
+            std::rethrow_exception(m_exception);
+        }
+        if constexpr (!std::is_void_v<T>) {
+            return std::move(*m_result);
+        }
+    }
+
+private:
+
+    void complete()
+    {
+        if (m_state.exchange(detail::AWAIT_DONE) == detail::AWAIT_SUSPENDED) {
+            detail::resume_on(m_executor, m_handle);
+        }
+    }
+
+    struct Empty {};
+
+    starter_type                        m_starter;
+    Executor*                           m_executor      = nullptr;
+    coroutine_handle<>                  m_handle;
+    atomic<int>                         m_state         = detail::AWAIT_STARTING;
+    std::optional<std::conditional_t<std::is_void_v<T>, Empty, T>>
+                                        m_result;
+    std::exception_ptr                  m_exception;
+};
+
+
+
+template <typename MESSAGE_T, typename SENDER_T>
+struct Message_awaitable
+{
+    explicit Message_awaitable(Typed_instance_id<SENDER_T> sender):
+        m_sender(sender)
+    {}
+
+    Message_awaitable& on(Executor& executor) & { m_executor = &executor; return *this; }
+    Message_awaitable  on(Executor& executor) && { m_executor = &executor; return std::move(*this); }
+
+    bool await_ready() const { return false; }
+
+    void await_suspend(coroutine_handle<> h)
+    {
+        auto state = std::make_shared<State>();
+        state->handle = h;
+        state->executor = m_executor;
+        m_state = state;
+
+        // The lock keeps the slot from deactivating itself before its deactivator is known.
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->deactivator = s_mproc->activate(
+            [state](const MESSAGE_T& message) {
+                if (state->fired.exchange(true)) {
+                    // a reader that had loaded the slot before it was deactivated
+                    return;
+                }
+                state->message = hold(message);
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->deactivator();
+                }
+                detail::resume_on(state->executor, state->handle);
+            },
+            m_sender);
+    }
+
+    shared_ptr<const MESSAGE_T> await_resume() { return m_state->message; }
+
+private:
+
+    struct State
+    {
+        coroutine_handle<>              handle;
+        Executor*                       executor    = nullptr;
+        atomic<bool>                    fired       = false;
+        std::mutex                      mutex;
+        function<void()>                deactivator;
+        shared_ptr<const MESSAGE_T>     message;
+    };
+
+    Typed_instance_id<SENDER_T>         m_sender;
+    Executor*                           m_executor  = nullptr;
+    shared_ptr<State>                   m_state;
+};
+
+
+
+// Awaits the next message of the specified type, sent by the specified sender.
+template <typename MESSAGE_T, typename SENDER_T = void>
+Message_awaitable<MESSAGE_T, SENDER_T> next(
+    Typed_instance_id<SENDER_T> sender_id = Typed_instance_id<void>(any_local_or_remote))
+{
+    return Message_awaitable<MESSAGE_T, SENDER_T>(sender_id);
+}
+
+
+
+struct Detached_task
+{
+    struct promise_type
+    {
+        Detached_task get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+
+} // namespace sintra
+
+
+#endif // SINTRA_COROUTINES
+
+
+#endif
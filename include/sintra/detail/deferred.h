@@ -0,0 +1,217 @@
+/*
+Copyright 2017 Ioannis Makris
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef SINTRA_DEFERRED_H
+#define SINTRA_DEFERRED_H
+
+
+#include <cassert>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+
+namespace sintra {
+
+
+using std::condition_variable;
+using std::function;
+using std::lock_guard;
+using std::mutex;
+using std::shared_ptr;
+using std::unique_lock;
+
+
+/*
+
+An exported function may return a deferred<T> instead of a T, in which case its result may be
+provided after it returns, from any thread, without blocking the thread handling the call.
+
+1. The function either returns a value, which converts to a completed deferred<T>, or a token
+   made with make_deferred<T>(), which it keeps, e.g. along with other pending calls.
+
+2. The token is completed with complete() or fail(), once. Copies of the token refer to the
+   same call, thus any of them may complete it.
+
+3. The reply to the caller is written when the token is completed, or when the function
+   returns, if it was completed already. To the caller, the function returns a T, like any
+   other, thus whether it is deferred is an implementation detail of the callee.
+
+4. A token that is never completed leaves the caller waiting, unless it has a timeout (see
+   Rpc_timeout), or the process of the callee terminates.
+
+*/
+
+
+template <typename T>
+class deferred
+{
+    static_assert(!std::is_void_v<T> && !std::is_reference_v<T>,
+        "A deferred result must be a value.");
+
+public:
+
+    using value_type = T;
+
+    // An empty token, which cannot be completed.
+    deferred() {}
+
+    // A completed token.
+    deferred(T value):
+        m_state(std::make_shared<State>())
+    {
+        m_state->value.emplace(std::move(value));
+        m_state->done = true;
+    }
+
+
+    void complete(T value) const
+    {
+        unique_lock<mutex> lock(m_state->m);
+        if (m_state->done) {
+            assert(!"The deferred result has already been completed.");
+            return;
+        }
+        m_state->value.emplace(std::move(value));
+        finish(lock);
+    }
+
+
+    void fail(std::exception_ptr error) const
+    {
+        unique_lock<mutex> lock(m_state->m);
+        if (m_state->done) {
+            assert(!"The deferred result has already been completed.");
+            return;
+        }
+        m_state->error = error;
+        finish(lock);
+    }
+
+
+    bool ready() const
+    {
+        lock_guard<mutex> lock(m_state->m);
+        return m_state->done;
+    }
+
+
+    // Waits until the token is completed, then returns its value, or rethrows its error.
+    T get() const
+    {
+        unique_lock<mutex> lock(m_state->m);
+        m_state->cv.wait(lock, [&]() { return m_state->done; });
+        if (m_state->error) {
+            std::rethrow_exception(m_state->error);
+        }
+        return *m_state->value;
+    }
+
+
+    // Calls f once the token is completed, from the completing thread, or right away, if it
+    // already is. Exactly one of the arguments of f is set. This is meant for the RPC handler.
+    void on_completion(function<void(const T*, std::exception_ptr)> f) const
+    {
+        unique_lock<mutex> lock(m_state->m);
+        if (!m_state->done) {
+            m_state->on_done = std::move(f);
+            return;
+        }
+        lock.unlock();
+        f(m_state->error ? nullptr : &*m_state->value, m_state->error);
+    }
+
+
+private:
+
+    struct State
+    {
+        mutex                                           m;
+        condition_variable                              cv;
+        bool                                            done        = false;
+        std::optional<T>                                value;
+        std::exception_ptr                              error;
+        function<void(const T*, std::exception_ptr)>    on_done;
+    };
+
+
+    // The state is no longer modified once it is done, thus it is read without the lock.
+    void finish(unique_lock<mutex>& lock) const
+    {
+        m_state->done = true;
+        auto f = std::move(m_state->on_done);
+        m_state->cv.notify_all();
+        lock.unlock();
+
+        if (f) {
+            f(m_state->error ? nullptr : &*m_state->value, m_state->error);
+        }
+    }
+
+
+    shared_ptr<State>                   m_state;
+
+    template <typename U>
+    friend deferred<U> make_deferred();
+};
+
+
+// Makes a token that is completed later (see deferred).
+template <typename T>
+deferred<T> make_deferred()
+{
+    deferred<T> ret;
+    ret.m_state = std::make_shared<typename deferred<T>::State>();
+    return ret;
+}
+
+
+// The type returned to the caller of a function returning R.
+template <typename R>
+struct undeferred
+{
+    using type = R;
+    static constexpr bool is_deferred = false;
+};
+
+
+template <typename T>
+struct undeferred<deferred<T>>
+{
+    using type = T;
+    static constexpr bool is_deferred = true;
+};
+
+
+} // namespace sintra
+
+
+#endif
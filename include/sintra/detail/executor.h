@@ -0,0 +1,365 @@
+/*
+Copyright 2017 Ioannis Makris
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SINTRA_EXECUTOR_H
+#define SINTRA_EXECUTOR_H
+
+
+#include "id_types.h"
+#include "message.h"
+#include "process_message_reader.h"
+#include "resolve_type.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+
+namespace sintra {
+
+
+using std::atomic;
+using std::condition_variable;
+using std::deque;
+using std::function;
+using std::lock_guard;
+using std::mutex;
+using std::thread;
+using std::unique_lock;
+using std::vector;
+
+
+/*
+
+By default, handlers run on the request reader thread of the process that sent the message,
+thus a slow handler delays every message that follows it from the same process. A handler
+may instead be bound to an executor, in which case the reader only hands the message over
+and moves on.
+
+1. Event handlers are bound with bind_executor(), and RPC exports with
+   Transceiver::set_rpc_executor().
+
+2. The message is held for the handler with hold(), which retains it in its ring if possible,
+   and copies it otherwise.
+
+3. Functions posted with the same non-zero ordering key run one at a time, in the order in
+   which they were posted. Bound handlers use the instance id of the sender as the key, unless
+   ordering was not requested, in which case handlers of the same sender may run concurrently.
+
+4. Posting never blocks the reader. The executor, as well as whatever a bound handler
+   refers to, must outlive the handlers that have been posted to it. Deactivating a handler
+   does not cancel the messages already posted to its executor.
+
+*/
+
+
+struct Executor
+{
+    virtual ~Executor() {}
+
+    virtual void post(function<void()> f, uint64_t ordering_key = 0) = 0;
+};
+
+
+
+// Runs everything on the calling thread, which is the default behaviour.
+struct Inline_executor: Executor
+{
+    void post(function<void()> f, uint64_t) override { f(); }
+};
+
+
+
+// A pool of threads, each with its own queue. Idle threads steal unordered functions from the
+// queues of busy ones. Ordered functions are assigned to a thread by their key and are never
+// stolen, which keeps their order.
+struct Thread_pool_executor: Executor
+{
+    Thread_pool_executor(size_t num_threads = thread::hardware_concurrency()):
+        m_workers(std::max(num_threads, size_t(1)))
+    {
+        for (size_t i = 0; i < m_workers.size(); i++) {
+            m_workers[i].m_thread = thread([this, i]() { worker_function(i); });
+        }
+    }
+
+
+    // Runs whatever has already been posted, then joins the threads.
+    ~Thread_pool_executor()
+    {
+        {
+            lock_guard<mutex> lk(m_idle_mutex);
+            m_stopping = true;
+        }
+        m_idle_condition.notify_all();
+        for (auto& w : m_workers) {
+            w.m_thread.join();
+        }
+    }
+
+
+    Thread_pool_executor(const Thread_pool_executor&) = delete;
+    const Thread_pool_executor& operator = (const Thread_pool_executor&) = delete;
+
+
+    void post(function<void()> f, uint64_t ordering_key = 0) override
+    {
+        size_t index;
+        if (ordering_key) {
+            index = size_t(ordering_key % m_workers.size());
+        }
+        else
+        if (s_tl_pool == this) {
+            index = s_tl_worker_index;
+        }
+        else {
+            index = m_next_worker++ % m_workers.size();
+        }
+
+        auto& w = m_workers[index];
+        {
+            lock_guard<mutex> lk(w.m_mutex);
+            w.m_tasks.push_back({std::move(f), ordering_key});
+            w.m_num_tasks++;
+        }
+
+        {
+            lock_guard<mutex> lk(m_idle_mutex);
+            if (!ordering_key) {
+                m_num_stealable++;
+            }
+        }
+
+        // An ordered function may only be run by its own worker, which is not necessarily the
+        // one that would be woken up.
+        if (ordering_key) {
+            m_idle_condition.notify_all();
+        }
+        else {
+            m_idle_condition.notify_one();
+        }
+    }
+
+
+private:
+
+    struct Task
+    {
+        function<void()>                f;
+        uint64_t                        ordering_key;
+    };
+
+
+    struct Worker
+    {
+        mutex                           m_mutex;
+        deque<Task>                     m_tasks;
+        atomic<size_t>                  m_num_tasks     = 0;
+        thread                          m_thread;
+    };
+
+
+    bool pop(size_t index, Task& task)
+    {
+        auto& w = m_workers[index];
+        lock_guard<mutex> lk(w.m_mutex);
+        if (w.m_tasks.empty()) {
+            return false;
+        }
+        task = std::move(w.m_tasks.front());
+        w.m_tasks.pop_front();
+        w.m_num_tasks--;
+        return true;
+    }
+
+
+    bool steal(size_t thief_index, Task& task)
+    {
+        for (size_t i = 1; i < m_workers.size(); i++) {
+            auto& w = m_workers[(thief_index + i) % m_workers.size()];
+            lock_guard<mutex> lk(w.m_mutex);
+            for (auto it = w.m_tasks.rbegin(); it != w.m_tasks.rend(); ++it) {
+                if (!it->ordering_key) {
+                    task = std::move(*it);
+                    w.m_tasks.erase(std::next(it).base());
+                    w.m_num_tasks--;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+
+    void worker_function(size_t index)
+    {
+        s_tl_pool = this;
+        s_tl_worker_index = index;
+
+        auto& w = m_workers[index];
+        Task task;
+        while (true) {
+            if (pop(index, task) || steal(index, task)) {
+                if (!task.ordering_key) {
+                    lock_guard<mutex> lk(m_idle_mutex);
+                    m_num_stealable--;
+                }
+                task.f();
+                task.f = nullptr;
+                continue;
+            }
+
+            unique_lock<mutex> lk(m_idle_mutex);
+            m_idle_condition.wait(lk, [&]() {
+                return m_stopping || w.m_num_tasks || m_num_stealable;
+            });
+            if (m_stopping && !w.m_num_tasks && !m_num_stealable) {
+                break;
+            }
+        }
+
+        s_tl_pool = nullptr;
+    }
+
+
+    vector<Worker>                      m_workers;
+    atomic<size_t>                      m_next_worker   = 0;
+
+    mutex                               m_idle_mutex;
+    condition_variable                  m_idle_condition;
+    size_t                              m_num_stealable = 0;
+    bool                                m_stopping      = false;
+
+    inline static thread_local Thread_pool_executor*
+                                        s_tl_pool           = nullptr;
+    inline static thread_local size_t   s_tl_worker_index   = 0;
+};
+
+
+
+// Runs the functions posted to it one at a time, in the order in which they were posted, on
+// the executor it was made with. Ordering keys are ignored, since everything is ordered.
+struct Strand: Executor
+{
+    Strand(Executor& executor): m_executor(executor) {}
+
+    Strand(const Strand&) = delete;
+    const Strand& operator = (const Strand&) = delete;
+
+
+    void post(function<void()> f, uint64_t = 0) override
+    {
+        {
+            lock_guard<mutex> lk(m_mutex);
+            m_tasks.push_back(std::move(f));
+            if (m_running) {
+                return;
+            }
+            m_running = true;
+        }
+        m_executor.post([this]() { run(); });
+    }
+
+
+private:
+
+    void run()
+    {
+        while (true) {
+            function<void()> f;
+            {
+                lock_guard<mutex> lk(m_mutex);
+                if (m_tasks.empty()) {
+                    m_running = false;
+                    return;
+                }
+                f = std::move(m_tasks.front());
+                m_tasks.pop_front();
+            }
+            f();
+        }
+    }
+
+
+    Executor&                           m_executor;
+    mutex                               m_mutex;
+    deque<function<void()>>             m_tasks;
+    bool                                m_running       = false;
+};
+
+
+
+// A slot that hands the messages over to an executor. See bind_executor().
+template <typename FT>
+struct Executor_bound_slot
+{
+    using arg_type   = decltype(resolve_single_functor_arg(std::declval<FT>()));
+    using value_type = std::decay_t<arg_type>;
+
+    void operator()(arg_type arg) const
+    {
+        auto slot = m_slot;
+
+        if constexpr (std::is_base_of_v<Message_prefix, value_type>) {
+            auto message = hold(arg);
+            auto key = m_ordered ? message->sender_instance_id : 0;
+            m_executor->post([slot, message]() { slot(*message); }, key);
+        }
+        else {
+            // The value is taken out of the message by the caller, thus the sender is only
+            // known through the message being dispatched.
+            auto key = m_ordered && s_tl_current_message ?
+                s_tl_current_message->sender_instance_id : 0;
+            m_executor->post([slot, value = value_type(arg)]() { slot(value); }, key);
+        }
+    }
+
+    FT                                  m_slot;
+    Executor*                           m_executor;
+    bool                                m_ordered;
+};
+
+
+// Wraps a slot, so that it runs on the specified executor, rather than on the reader thread.
+// The result may be activated as the slot itself. If ordered is true, the messages of each
+// sender are handled in the order in which they were sent.
+template <typename FT>
+Executor_bound_slot<FT> bind_executor(Executor& executor, const FT& slot, bool ordered = true)
+{
+    return Executor_bound_slot<FT>{slot, &executor, ordered};
+}
+
+
+} // namespace sintra
+
+
+#endif
@@ -0,0 +1,364 @@
+/*
+Copyright 2017 Ioannis Makris
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SINTRA_HANDLER_DISPATCH_H
+#define SINTRA_HANDLER_DISPATCH_H
+
+
+#include "config.h"
+#include "id_types.h"
+#include "message.h"
+
+#include <atomic>
+#include <cassert>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+namespace sintra {
+
+
+using std::atomic;
+using std::deque;
+using std::function;
+using std::mutex;
+using std::shared_ptr;
+using std::unordered_map;
+using std::vector;
+
+
+/*
+
+The event handlers of the process are dispatched from an immutable snapshot of the handler
+registry, so that reader threads do not need to take any lock.
+
+0. In the snapshot, the records of the message types are stored in a flat array, indexed by
+   dense_type_index(), and each record is a contiguous list of (sender, handler) entries.
+
+1. The registry (Managed_process::m_active_handlers) remains the authoritative record, and it
+   is only modified under m_handlers_mutex. After each modification, the record of the
+   affected message type is rebuilt and a new snapshot is published. Records of other types
+   are shared among snapshots.
+
+2. Reader threads register a slot, in which they store the current epoch before loading the
+   snapshot, and clear it once they are done dispatching.
+
+3. A replaced snapshot is retired along with the epoch that followed its replacement, and it
+   is deleted once no slot holds an earlier epoch.
+
+4. Deactivating a handler waits until no reader may still be running it, except when it is
+   called from a reader thread (e.g. a handler deactivating itself or another one), in which
+   case the handler may be invoked once more, by readers that had already loaded the
+   previous snapshot.
+
+5. If all the slots are taken, a thread that is not registered shares an overflow slot with
+   any other such thread, one at a time, for the lifetime of its guard. This is slower, but
+   the slots are shared by all the readers of the process, as well as by any thread emitting
+   local events, thus it may happen.
+
+*/
+
+
+// Types beyond this index (which should not occur in practice) are kept in a map instead.
+constexpr size_t max_dense_type_index = 0x10000;
+
+
+// Type ids are either reserved or assigned sequentially by the coordinator, right after the
+// reserved ones, thus they can be mapped to dense indices without any lookup.
+inline
+size_t dense_type_index(type_id_type message_type_id)
+{
+    constexpr auto num_low = (type_id_type)detail::reserved_id::num_low_reserved_type_ids;
+    constexpr auto base    = (type_id_type)detail::reserved_id::base_of_messages_handled_by_coordinator;
+
+    if (message_type_id < num_low) {
+        return size_t(message_type_id);
+    }
+    if (message_type_id < base) {
+        return max_dense_type_index;
+    }
+    return size_t(message_type_id - base + num_low);
+}
+
+
+struct Dispatch_snapshot
+{
+    // Each entry holds either a handler or a batch handler (see activate_batch()).
+    struct Entry
+    {
+        instance_id_type                        sender;
+        function<void(const Message_prefix&)>   handler;
+        function<void(Message_prefix* const*, size_t)>
+                                                batch_handler;
+    };
+
+    // The handlers of a message type. Handlers of specific senders come first, followed by
+    // those of any_remote and then any_local_or_remote, in order of activation. Batch handlers
+    // follow in the same order, after all the others.
+    using type_record_type = vector<Entry>;
+
+
+    // Returns the handlers of the specified type, or nullptr if there are none.
+    const type_record_type* find(type_id_type message_type_id) const
+    {
+        auto index = dense_type_index(message_type_id);
+        if (index < records.size()) {
+            return records[index].get();
+        }
+        if (index >= max_dense_type_index) {
+            auto it = sparse_records.find(message_type_id);
+            return it != sparse_records.end() ? it->second.get() : nullptr;
+        }
+        return nullptr;
+    }
+
+
+    void set(type_id_type message_type_id, shared_ptr<const type_record_type> record)
+    {
+        auto index = dense_type_index(message_type_id);
+        if (index >= max_dense_type_index) {
+            if (record) {
+                sparse_records[message_type_id] = std::move(record);
+            }
+            else {
+                sparse_records.erase(message_type_id);
+            }
+            return;
+        }
+
+        if (index >= records.size()) {
+            if (!record) {
+                return;
+            }
+            records.resize(index + 1);
+        }
+        records[index] = std::move(record);
+    }
+
+
+    vector<shared_ptr<const type_record_type>>  records;
+    unordered_map<type_id_type, shared_ptr<const type_record_type>>
+                                                sparse_records;
+};
+
+
+
+struct Handler_dispatch
+{
+    static constexpr int max_readers = 2 * max_process_index;
+
+    // the last slot, which is shared by the threads that found no free slot
+    static constexpr int overflow_slot = max_readers;
+
+
+    struct alignas(assumed_cache_line_size) Slot
+    {
+        atomic<uint64_t>                epoch;
+        atomic<bool>                    in_use;
+    };
+
+
+    Handler_dispatch()
+    {
+        for (auto& s : m_slots) {
+            s.epoch = 0;
+            s.in_use = false;
+        }
+    }
+
+
+    ~Handler_dispatch()
+    {
+        delete m_snapshot.load();
+        for (auto& r : m_retired) {
+            delete r.first;
+        }
+    }
+
+
+    Handler_dispatch(const Handler_dispatch&) = delete;
+    const Handler_dispatch& operator = (const Handler_dispatch&) = delete;
+
+
+    // Called once by each thread that dispatches events, before doing so. If there is no free
+    // slot, the thread remains unregistered, thus its guards use the overflow slot.
+    bool register_reader()
+    {
+        assert(s_tl_slot < 0);
+        for (int i = 0; i < max_readers; i++) {
+            bool f = false;
+            if (m_slots[i].in_use.compare_exchange_strong(f, true)) {
+                s_tl_slot = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+
+    // Makes the overflow slot the slot of the calling thread, once no other thread holds it.
+    bool acquire_overflow_slot()
+    {
+        m_overflow_mutex.lock();
+        s_tl_slot = overflow_slot;
+        return true;
+    }
+
+
+    void unregister_reader()
+    {
+        if (s_tl_slot >= 0 && s_tl_slot != overflow_slot) {
+            m_slots[s_tl_slot].epoch = 0;
+            m_slots[s_tl_slot].in_use = false;
+            s_tl_slot = -1;
+        }
+    }
+
+
+    // Keeps the snapshot loaded in its constructor valid, for as long as it exists.
+    // Guards may be nested, in which case the outermost one determines the epoch.
+    // A thread that is not registered as a reader is registered for the lifetime of the guard,
+    // or if there is no free slot, it holds the overflow slot.
+    struct Read_guard
+    {
+        Read_guard(Handler_dispatch& d):
+            m_dispatch(d),
+            m_registered_here(s_tl_slot < 0 && d.register_reader()),
+            m_overflow(s_tl_slot < 0 && d.acquire_overflow_slot()),
+            m_slot(d.m_slots[s_tl_slot])
+        {
+            m_outermost = m_slot.epoch.load() == 0;
+            if (m_outermost) {
+                m_slot.epoch.store(d.m_epoch.load());
+            }
+            m_snapshot = d.m_snapshot.load();
+        }
+
+        ~Read_guard()
+        {
+            if (m_outermost) {
+                m_slot.epoch.store(0, std::memory_order_release);
+            }
+            if (m_registered_here) {
+                m_dispatch.unregister_reader();
+            }
+            if (m_overflow) {
+                s_tl_slot = -1;
+                m_dispatch.m_overflow_mutex.unlock();
+            }
+        }
+
+        const Dispatch_snapshot* operator->() const { return m_snapshot; }
+
+    private:
+        Handler_dispatch&           m_dispatch;
+        bool                        m_registered_here;
+        bool                        m_overflow;
+        Slot&                       m_slot;
+        const Dispatch_snapshot*    m_snapshot;
+        bool                        m_outermost;
+    };
+
+
+    // Publishes a snapshot in which the record of the specified type is replaced.
+    // A null record removes the type. Must be called with the handlers mutex locked.
+    void publish(type_id_type message_type_id, shared_ptr<const Dispatch_snapshot::type_record_type> record)
+    {
+        auto snapshot = new Dispatch_snapshot(*m_snapshot.load());
+        snapshot->set(message_type_id, std::move(record));
+
+        auto old = m_snapshot.exchange(snapshot);
+        m_retired.emplace_back(old, ++m_epoch);
+        reclaim();
+    }
+
+
+    // Waits until no reader may be using a snapshot published before the latest one.
+    // Readers are not waited for by themselves.
+    void synchronize()
+    {
+        auto epoch = m_epoch.load();
+        for (int i = 0; i <= overflow_slot; i++) {
+            if (i == s_tl_slot) {
+                continue;
+            }
+            while (true) {
+                auto e = m_slots[i].epoch.load();
+                if (e == 0 || e >= epoch) {
+                    break;
+                }
+                std::this_thread::yield();
+            }
+        }
+    }
+
+
+    static bool is_reader_thread() { return s_tl_slot >= 0; }
+
+
+private:
+
+    void reclaim()
+    {
+        uint64_t min_epoch = m_epoch.load();
+        for (auto& s : m_slots) {
+            auto e = s.epoch.load();
+            if (e && e < min_epoch) {
+                min_epoch = e;
+            }
+        }
+
+        while (!m_retired.empty() && m_retired.front().second <= min_epoch) {
+            delete m_retired.front().first;
+            m_retired.pop_front();
+        }
+    }
+
+
+    Slot                                m_slots[max_readers + 1];
+
+    // held by the thread using the overflow slot
+    mutex                               m_overflow_mutex;
+    atomic<uint64_t>                    m_epoch         = 1;
+    atomic<Dispatch_snapshot*>          m_snapshot      = new Dispatch_snapshot;
+
+    // replaced snapshots, along with the epoch that followed their replacement
+    deque<std::pair<Dispatch_snapshot*, uint64_t>>
+                                        m_retired;
+
+    inline static thread_local int      s_tl_slot       = -1;
+};
+
+
+} // namespace sintra
+
+
+#endif
@@ -66,6 +66,7 @@ namespace detail {
         make_process_group,
         print,
         barrier,
+        instances_of_type,
 
         // EXPLICITLY DEFINED SIGNALS
         //instance_invalidated, // sent by Transceiver on destruction
@@ -73,10 +74,14 @@ namespace detail {
                               // and can be subsequently looked up by its name.
         instance_unpublished, // sent by Coordinator, always before the
                               // Transceiver sends instance_invalidated
+        oneway_rpc_failure,   // sent by a Transceiver whose one-way function failed
+        rpc_stream_credit,    // sent by the caller of a streamed function, to its callee
 
         // SPECIAL MESSAGE IDENTIFIERS
         exception,
-        deferral,
+        rpc_stream_end,       // the last reply of a streamed function
+        message_padding,      // fills the gap before a message that must be aligned
+        relayed_by_reference, // stands for a message in the ring of another process
 
         // EXCEPTION TYPES
         std_invalid_argument,
@@ -92,6 +97,9 @@ namespace detail {
         std_exception,
         unknown_exception,
 
+        // marks the end of the ids above, which are followed by a gap
+        num_low_reserved_type_ids,
+
         // EXPLICITLY DEFINED SIGNALS HANDLED BY COORDINATOR
         base_of_messages_handled_by_coordinator = 0x80000000,
         terminated_abnormally,
@@ -0,0 +1,221 @@
+/*
+Copyright 2017 Ioannis Makris
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SINTRA_INTEREST_MAP_H
+#define SINTRA_INTEREST_MAP_H
+
+
+#include "handler_dispatch.h"
+#include "id_types.h"
+#include "ipc_rings.h"
+
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+
+namespace sintra {
+
+
+using std::atomic;
+using std::string;
+
+
+/*
+
+The coordinator relays every interprocess event to its own ring, which is read by all the
+processes of the swarm, thus every process would otherwise read every event, including those
+of types it has no handlers for. To avoid this, processes publish the message types they are
+interested in, and the coordinator only relays the events that are of interest to some
+process other than the sender's.
+
+1. The interest map is a region in the swarm directory, holding a bitmap of message types for
+   each process index, in which bits are addressed by dense_type_index(). It is created by the
+   process of the coordinator, before any other process is spawned, and the rest attach to it.
+
+2. A process only modifies its own bitmap, which it does whenever the handlers of a type are
+   published (see Managed_process::publish_handlers()). A type is of interest if it has
+   handlers for senders that are not local, since local senders do not need the relay.
+
+3. The reserved message types, as well as types beyond the range of the bitmap, are always
+   of interest.
+
+4. The bit is set before the handler becomes reachable by any message the process sends
+   afterwards, thus an event sent in response to such a message will be relayed. Events sent
+   concurrently with the activation may or may not be, as was already the case.
+
+5. The bitmap of a process is cleared by the coordinator once the process is unpublished,
+   in case it did not exit cleanly.
+
+*/
+
+
+struct Interest_map
+{
+    static constexpr size_t num_words_per_process = max_dense_type_index / 64;
+    static constexpr size_t num_processes = max_process_index + 1;
+    static constexpr size_t region_size =
+        num_processes * num_words_per_process * sizeof(uint64_t);
+
+
+    Interest_map(const string& directory, bool owner):
+        m_owner(owner)
+    {
+        m_filename = directory + "/interest";
+
+        if ((m_owner && !create()) || !attach()) {
+            throw std::runtime_error("Failed to acquire the interest map.");
+        }
+    }
+
+
+    ~Interest_map()
+    {
+        delete m_region;
+        m_region = nullptr;
+        m_words = nullptr;
+    }
+
+
+    Interest_map(const Interest_map&) = delete;
+    const Interest_map& operator = (const Interest_map&) = delete;
+
+
+    void set(instance_id_type process_iid, type_id_type message_type_id, bool interested)
+    {
+        auto index = dense_type_index(message_type_id);
+        if (index >= max_dense_type_index) {
+            return;
+        }
+
+        auto& word = row(process_iid)[index / 64];
+        uint64_t bit = uint64_t(1) << (index % 64);
+        if (interested) {
+            word.fetch_or(bit);
+        }
+        else {
+            word.fetch_and(~bit);
+        }
+    }
+
+
+    void clear(instance_id_type process_iid)
+    {
+        auto r = row(process_iid);
+        for (size_t i = 0; i < num_words_per_process; i++) {
+            r[i].store(0);
+        }
+    }
+
+
+    // True if any process, other than the specified one, is interested in the type.
+    bool is_of_interest(type_id_type message_type_id, instance_id_type excluded_process_iid) const
+    {
+        if (message_type_id <= (type_id_type)detail::reserved_id::num_reserved_type_ids) {
+            return true;
+        }
+
+        auto index = dense_type_index(message_type_id);
+        if (index >= max_dense_type_index) {
+            return true;
+        }
+
+        size_t word = index / 64;
+        uint64_t bit = uint64_t(1) << (index % 64);
+        auto excluded = get_process_index(excluded_process_iid);
+        for (size_t p = 0; p < num_processes; p++) {
+            if (p != excluded &&
+                m_words[p * num_words_per_process + word].load(std::memory_order_relaxed) & bit)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+
+private:
+
+    atomic<uint64_t>* row(instance_id_type process_iid) const
+    {
+        auto p = get_process_index(process_iid);
+        assert(p < num_processes);
+        return m_words + p * num_words_per_process;
+    }
+
+
+    bool create()
+    {
+        try {
+            ipc::file_handle_t fh =
+                ipc::ipcdetail::create_new_file(m_filename.c_str(), ipc::read_write);
+            if (fh == ipc::ipcdetail::invalid_file())
+                return false;
+
+            // a zero filled file is a map with no interests
+            if (!ipc::ipcdetail::truncate_file(fh, region_size))
+                return false;
+
+            return ipc::ipcdetail::close_file(fh);
+        }
+        catch (...) {
+        }
+        return false;
+    }
+
+
+    bool attach()
+    {
+        try {
+            if (fs::file_size(m_filename) != region_size) {
+                return false;
+            }
+
+            ipc::file_mapping file(m_filename.c_str(), ipc::read_write);
+            m_region = new ipc::mapped_region(file, ipc::read_write, 0, region_size);
+            m_words = (atomic<uint64_t>*)m_region->get_address();
+            return true;
+        }
+        catch (...) {
+            return false;
+        }
+    }
+
+
+    const bool                          m_owner;
+    string                              m_filename;
+    ipc::mapped_region*                 m_region            = nullptr;
+    atomic<uint64_t>*                   m_words             = nullptr;
+};
+
+
+} // namespace sintra
+
+
+#endif
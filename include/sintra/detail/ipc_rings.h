@@ -524,6 +524,12 @@ struct Ring: Ring_data<T, READ_ONLY_DATA>
         cache_line_sized_t<sequence_counter_type>
                                         reading_sequences[max_process_index];
 
+        // The sequence before which each reader has finished with all the data, which, unlike
+        // the reading sequence, does not include the range being processed. Unused slots are
+        // set to invalid_sequence.
+        cache_line_sized_t<atomic<sequence_counter_type>>
+                                        trailing_sequences[max_process_index];
+
 
         int                             free_rs_stack[max_process_index];
         int                             num_free_rs = max_process_index;
@@ -575,6 +581,7 @@ struct Ring: Ring_data<T, READ_ONLY_DATA>
 #endif
 
             for (int i = 0; i < max_process_index; i++) { reading_sequences[i].v = invalid_sequence; }
+            for (int i = 0; i < max_process_index; i++) { trailing_sequences[i].v = invalid_sequence; }
             for (int i = 0; i < max_process_index; i++) { free_rs_stack[i] = i; }
 
 
@@ -764,6 +771,11 @@ struct Ring_R: Ring<T, true>
     ~Ring_R()
     {
         done_reading();
+
+        // any pins still held would block the writer indefinitely
+        for (size_t i = 0; i < 8; i++) {
+            c.read_access -= uint64_t(m_pins[i]) << (8 * i);
+        }
     }
 
 
@@ -785,6 +797,14 @@ struct Ring_R: Ring<T, true>
 
         assert(num_trailing_elements <= m_max_trailing_elements);
 
+        // allocate reading sequence
+        m_rs_index = c.free_rs_stack[--c.num_free_rs];
+        m_reading_sequence = &c.reading_sequences[m_rs_index].v;
+
+        // Until the range is known, the writer must assume that nothing has been read, since
+        // it may otherwise miss this reader (see get_min_trailing_sequence()).
+        c.trailing_sequences[m_rs_index].v = 0;
+
         // this prevents the writer from progressing beyond the end of the octile that
         // succeeds the one it is currently on
         uint64_t access_mask = 0x0101010101010101;
@@ -812,12 +832,7 @@ struct Ring_R: Ring<T, true>
         assert(ret.end >= ret.begin);
         assert(ret.begin >= this->m_data);
 
-
-
-        // allocate reading sequence
-        m_rs_index = c.free_rs_stack[--c.num_free_rs];
-        m_reading_sequence = &c.reading_sequences[m_rs_index].v;
-
+        c.trailing_sequences[m_rs_index].v = range_first_sequence;
 
         // advance to the leading sequence that was read in the beginning
         // this way the function will work orthogonally to wait_for_new_data()
@@ -837,6 +852,7 @@ struct Ring_R: Ring<T, true>
             c.read_access -= uint64_t(1) << (8 * m_trailing_octile);
             *m_reading_sequence = m_trailing_octile = 0;
             m_reading = false;
+            c.trailing_sequences[m_rs_index].v = invalid_sequence;
 
             // release reading sequence
             c.free_rs_stack[c.num_free_rs++] = m_rs_index;
@@ -854,23 +870,30 @@ struct Ring_R: Ring<T, true>
     // The caller must call done_reading_new_data() to move the read
     const Range<T> wait_for_new_data()
     {
+        // the previous range, if any, has been processed
+        if (m_rs_index >= 0) {
+            c.trailing_sequences[m_rs_index].v = *m_reading_sequence;
+        }
 
 #if SINTRA_RING_READING_POLICY == SINTRA_RING_READING_POLICY_ALWAYS_SPIN
 
-        while (*m_reading_sequence == c.leading_sequence.load() ) {}
+        while (*m_reading_sequence == c.leading_sequence.load() && !m_stop_requested) {}
 
 #else // SINTRA_RING_READING_POLICY_HYBRID or SINTRA_RING_READING_POLICY_ALWAYS_SLEEP
 
 #if SINTRA_RING_READING_POLICY == SINTRA_RING_READING_POLICY_HYBRID
 
         double tl = get_wtime() + spin_before_sleep * 0.5;
-        while (*m_reading_sequence == c.leading_sequence.load() && get_wtime() < tl) {}
+        while (*m_reading_sequence == c.leading_sequence.load() && get_wtime() < tl &&
+            !m_stop_requested) {}
 
 #endif
 
+        // request_stop() sets the flag before locking, thus either it is seen here, or the
+        // reader is already registered as sleeping when the flag is set, and will be woken up.
         c.lock();
         m_sleepy_index = -1;
-        if (*m_reading_sequence == c.leading_sequence.load()) {
+        if (*m_reading_sequence == c.leading_sequence.load() && !m_stop_requested) {
             m_sleepy_index = c.ready_stack[--c.num_ready];
             c.sleeping_stack[c.num_sleeping++] = m_sleepy_index;
         }
@@ -893,6 +916,10 @@ struct Ring_R: Ring<T, true>
 
         Range<T> ret;
 
+        if (m_stop_requested) {
+            return ret;
+        }
+
         auto num_range_elements = size_t(c.leading_sequence.load() - *m_reading_sequence);
 
         if (num_range_elements == 0) {
@@ -926,6 +953,65 @@ struct Ring_R: Ring<T, true>
     }
 
 
+    // Keeps the octile of the specified element locked for reading, beyond the current reading
+    // range, until unpin() is called, which may happen from any thread. The element must be in
+    // the range currently being read, thus the writer cannot have entered its octile yet.
+    // Returns the octile, or -1 if pinning would exceed the limits.
+    int pin(const T* element)
+    {
+        // e.g. a message relayed by reference, which lives in another ring
+        if (element < this->m_data || element >= this->m_data + 2 * this->m_num_elements) {
+            return -1;
+        }
+
+        if (m_num_pins.fetch_add(1) >= max_retained_messages) {
+            m_num_pins--;
+            return -1;
+        }
+
+        size_t index = size_t(element - this->m_data) % this->m_num_elements;
+        int octile = int((8 * index) / this->m_num_elements);
+        auto shift = 8 * octile;
+
+        // Pins may not take more than half of the octile's counter, for the other half must
+        // accommodate any number of readers.
+        auto v = c.read_access.load();
+        do {
+            if (((v >> shift) & 0xff) >= 0x80) {
+                m_num_pins--;
+                return -1;
+            }
+        }
+        while (!c.read_access.compare_exchange_weak(v, v + (uint64_t(1) << shift)));
+
+        m_pins[octile]++;
+        return octile;
+    }
+
+
+    void unpin(int octile)
+    {
+        assert(octile >= 0 && octile < 8 && m_pins[octile] > 0);
+        m_pins[octile]--;
+        c.read_access -= uint64_t(1) << (8 * octile);
+        m_num_pins--;
+    }
+
+
+    // Makes wait_for_new_data() return an empty range, from now on, including any call that
+    // is currently blocking on a different thread. Unlike done_reading(), this may be called
+    // from any thread. The reading thread is expected to call done_reading() once it sees the
+    // empty range.
+    void request_stop()
+    {
+        m_stop_requested = true;
+        unblock_local();
+    }
+
+
+    bool stop_requested() const { return m_stop_requested; }
+
+
     // If start_reading_new_data() is either sleeping or spinning on a different thread,
     // this call will force it to return a nullptr and 0 elements.
     // Only the local reader instance will be affected.
@@ -947,8 +1033,11 @@ protected:
     size_t                              m_trailing_octile           = 0;
     atomic<bool>                        m_reading = false;
     atomic<bool>                        m_reading_lock = false;
+    atomic<bool>                        m_stop_requested            = false;
     int                                 m_sleepy_index              = -1;
     int                                 m_rs_index                  = -1;
+    atomic<int>                         m_num_pins                  = 0;
+    atomic<int>                         m_pins[8]                   = {};
 
     inline static sequence_counter_type s_zero_rs = 0;
 
@@ -1053,6 +1142,18 @@ struct Ring_W: Ring<T, false>
     }
 
 
+    // Takes exclusive write access, which is otherwise taken by the first write, and is
+    // released by done_writing(). This allows a writer to inspect get_pending_sequence()
+    // before writing, e.g. to align what it writes.
+    void acquire_write_access()
+    {
+        while (m_writing_thread != std::this_thread::get_id()) {
+            auto invalid_thread = thread::id();
+            m_writing_thread.compare_exchange_strong(invalid_thread, std::this_thread::get_id());
+        }
+    }
+
+
     void done_writing()
     {
         // update sequence
@@ -1107,6 +1208,35 @@ struct Ring_W: Ring<T, false>
     }
 
 
+    // The sequence that follows the last write, which might not be visible to the readers yet.
+    sequence_counter_type get_pending_sequence() const { return m_pending_new_sequence; }
+
+
+    // The sequence before which all readers have finished reading, or invalid_sequence if
+    // there are no readers.
+    sequence_counter_type get_min_trailing_sequence() const
+    {
+        auto ret = invalid_sequence;
+        for (auto& t : c.trailing_sequences) {
+            ret = std::min(ret, t.v.load());
+        }
+        return ret;
+    }
+
+
+    // Gives back the trailing num_elements of the last write, if they turned out to be unused.
+    // This may only be called before done_writing().
+    void discard_unused(size_t num_elements)
+    {
+        assert(m_writing_thread == std::this_thread::get_id());
+        m_pending_new_sequence -= num_elements;
+
+        // if this steps back to the previous octile, the next write will acquire the current
+        // one again.
+        m_octile = (8 * (m_pending_new_sequence % this->m_num_elements)) / this->m_num_elements;
+    }
+
+
     // This function allows a writer to read the ring's readable data, without locking.
     Range<T> get_readable_range()
     {
@@ -1131,10 +1261,7 @@ private:
         assert(num_elements_to_write <= this->m_num_elements/8);
 
         // assure exclusive write access
-        while (m_writing_thread != std::this_thread::get_id()) {
-            auto invalid_thread = thread::id();
-            m_writing_thread.compare_exchange_strong(invalid_thread, std::this_thread::get_id());
-        }
+        acquire_write_access();
 
         size_t index = m_pending_new_sequence % this->m_num_elements;
         m_pending_new_sequence += num_elements_to_write;
@@ -0,0 +1,330 @@
+/*
+Copyright 2017 Ioannis Makris
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SINTRA_LOCAL_EVENTS_H
+#define SINTRA_LOCAL_EVENTS_H
+
+
+#include "handler_dispatch.h"
+#include "id_types.h"
+#include "message.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+
+namespace sintra {
+
+
+using std::atomic;
+using std::condition_variable;
+using std::function;
+using std::lock_guard;
+using std::mutex;
+using std::thread;
+using std::unique_lock;
+
+
+/*
+
+Events sent to any_local, as well as the local share of those sent to any_local_or_remote,
+do not pass through the rings. They are delivered to the handlers of the process directly.
+
+1. The message is constructed in a heap buffer, or in the case of any_local_or_remote, copied
+   there from the ring, right after it is written. A local message holds a reference to the
+   blobs of its payload, if it was spilled.
+
+2. By default, local messages are pushed to a lock-free queue, from which a dedicated thread
+   dispatches them, in the order in which they were pushed. Alternatively (see
+   set_local_delivery()), they are dispatched synchronously, by the sending thread, before
+   send() returns.
+
+3. The readers skip the events that were sent to any_local_or_remote from this process, when
+   they come back through the coordinator's ring, since they have already been delivered.
+
+4. Local events only reach handlers activated for the specific sender, any_local or
+   any_local_or_remote.
+
+*/
+
+
+enum class Local_delivery
+{
+    queued,         // dispatched by a dedicated thread
+    synchronous     // dispatched by the sending thread
+};
+
+
+
+struct Local_message
+{
+    atomic<Local_message*>              next            = nullptr;
+    Message_prefix*                     message         = nullptr;
+
+
+    // Allocates a local message, with room for a message of the specified size, starting at
+    // an address with the specified alignment and phase (i.e. remainder modulo the alignment).
+    static Local_message* allocate(size_t num_bytes, size_t alignment, size_t phase = 0)
+    {
+        alignment = std::max(alignment, alignof(Message_prefix));
+        auto storage = new char[sizeof(Local_message) + alignment + num_bytes];
+        auto ret = new (storage) Local_message;
+
+        auto start = uintptr_t(storage + sizeof(Local_message));
+        ret->message =
+            (Message_prefix*)(start + (phase + alignment - start % alignment) % alignment);
+        return ret;
+    }
+
+
+    static void free(Local_message* lm)
+    {
+        if (lm->message && lm->message->blob_chain) {
+            auto pool = get_blob_pool(process_of(lm->message->sender_instance_id));
+            if (pool) {
+                pool->release_chain(lm->message->blob_chain);
+            }
+        }
+        lm->~Local_message();
+        delete [] (char*)lm;
+    }
+};
+
+
+
+// Constructs a message in a local message. This follows Message_ring_W::write(), including
+// the alignment of the payloads. num_extra_bytes is expected to be the return value of
+// vb_size(), evaluated on the same arguments right before the call.
+template <typename MESSAGE_T, typename... Args>
+Local_message* make_local_message(size_t num_extra_bytes, Args&&... args)
+{
+    using S = variable_buffer::S;
+
+    if (alignof(MESSAGE_T) > alignof(Message_prefix)) {
+        S::tl_payload_alignment = std::max(S::tl_payload_alignment, alignof(MESSAGE_T));
+    }
+
+    size_t alignment = std::max(S::tl_payload_alignment, alignof(MESSAGE_T));
+    num_extra_bytes += S::tl_num_payloads * (S::tl_payload_alignment - 1);
+
+    auto lm = Local_message::allocate(sizeof(MESSAGE_T) + num_extra_bytes, alignment);
+    new (lm->message) MESSAGE_T(std::forward<Args>(args)...);
+
+    S::tl_payload_alignment = 1;
+    S::tl_num_payloads = 0;
+
+    // the reference to the blobs was taken when they were allocated
+    return lm;
+}
+
+
+
+// Copies a message into a local message, keeping the alignment of its payloads.
+inline
+Local_message* copy_to_local_message(const Message_prefix& m)
+{
+    auto lm = Local_message::allocate(m.bytes_to_next_message, max_vb_alignment,
+        uintptr_t(&m) % max_vb_alignment);
+    memcpy((void*)lm->message, (const void*)&m, m.bytes_to_next_message);
+
+    if (m.blob_chain) {
+        auto pool = get_blob_pool(process_of(m.sender_instance_id));
+        if (pool) {
+            pool->add_ref_chain(m.blob_chain);
+        }
+    }
+    return lm;
+}
+
+
+
+// A multiple producer, single consumer queue of local messages, whose consumer is a thread
+// dispatching them. The thread is started with the first message.
+struct Local_event_queue
+{
+    Local_event_queue(Handler_dispatch& dispatch, function<void(Message_prefix&)> handler):
+        m_dispatch(dispatch),
+        m_handler(handler)
+    {}
+
+
+    ~Local_event_queue()
+    {
+        stop();
+    }
+
+
+    Local_event_queue(const Local_event_queue&) = delete;
+    const Local_event_queue& operator = (const Local_event_queue&) = delete;
+
+
+    void push(Local_message* lm)
+    {
+        // counted before it is linked, thus the consumer knows there is more to wait for
+        m_num_pending++;
+
+        lm->next.store(nullptr, std::memory_order_relaxed);
+        auto prev = m_head.exchange(lm);
+        prev->next.store(lm);
+
+        if (!m_started.load()) {
+            start();
+        }
+
+        if (m_sleeping) {
+            lock_guard<mutex> lk(m_mutex);
+            m_condition.notify_one();
+        }
+    }
+
+
+    // Dispatches whatever has been pushed, then joins the thread.
+    void stop()
+    {
+        {
+            lock_guard<mutex> lk(m_mutex);
+            m_stopping = true;
+            m_condition.notify_one();
+        }
+
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+
+        // anything pushed while stopping is discarded
+        while (auto lm = pop()) {
+            Local_message::free(lm);
+        }
+    }
+
+
+private:
+
+    void start()
+    {
+        lock_guard<mutex> lk(m_mutex);
+        if (!m_started && !m_stopping) {
+            m_thread = thread([this]() { consumer_function(); });
+            m_started = true;
+        }
+    }
+
+
+    // This is the intrusive queue of D. Vyukov, in which a message is only available once the
+    // message pushed before it is linked.
+    Local_message* pop()
+    {
+        auto tail = m_tail;
+        auto next = tail->next.load();
+
+        if (tail == &m_stub) {
+            if (!next) {
+                return nullptr;
+            }
+            m_tail = next;
+            tail = next;
+            next = next->next.load();
+        }
+
+        if (next) {
+            m_tail = next;
+            return tail;
+        }
+
+        if (tail != m_head.load()) {
+            // a producer is still linking its message
+            return nullptr;
+        }
+
+        m_stub.next.store(nullptr, std::memory_order_relaxed);
+        auto prev = m_head.exchange(&m_stub);
+        prev->next.store(&m_stub);
+
+        next = tail->next.load();
+        if (next) {
+            m_tail = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+
+    void consumer_function()
+    {
+        m_dispatch.register_reader();
+
+        while (true) {
+            if (auto lm = pop()) {
+                m_num_pending--;
+                m_handler(*lm->message);
+                Local_message::free(lm);
+                continue;
+            }
+
+            if (m_num_pending) {
+                // a producer is still linking its message
+                std::this_thread::yield();
+                continue;
+            }
+
+            unique_lock<mutex> lk(m_mutex);
+            m_sleeping = true;
+            m_condition.wait(lk, [&]() { return m_num_pending || m_stopping; });
+            m_sleeping = false;
+            if (m_stopping && !m_num_pending) {
+                break;
+            }
+        }
+
+        m_dispatch.unregister_reader();
+    }
+
+
+    Handler_dispatch&                   m_dispatch;
+    function<void(Message_prefix&)>     m_handler;
+
+    Local_message                       m_stub;
+    atomic<Local_message*>              m_head          = &m_stub;
+    Local_message*                      m_tail          = &m_stub;
+    atomic<size_t>                      m_num_pending   = 0;
+
+    thread                              m_thread;
+    atomic<bool>                        m_started       = false;
+    atomic<bool>                        m_sleeping      = false;
+    bool                                m_stopping      = false;
+    mutex                               m_mutex;
+    condition_variable                  m_condition;
+};
+
+
+} // namespace sintra
+
+
+#endif
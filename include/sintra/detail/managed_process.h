@@ -26,12 +26,18 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef SINTRA_MANAGED_PROCESS_H
 #define SINTRA_MANAGED_PROCESS_H
 
+#include "blob_pool.h"
 #include "config.h"
+#include "executor.h"
 #include "globals.h"
+#include "handler_dispatch.h"
+#include "interest_map.h"
 #include "ipc_rings.h"
+#include "local_events.h"
 #include "message.h"
 #include "process_message_reader.h"
 #include "resolve_type.h"
+#include "shared_arena.h"
 #include "spinlocked_containers.h"
 #include "transceiver.h"
 #include "utility/call_function_with_fusion_vector_args.h"
@@ -46,11 +52,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <float.h>
 #include <list>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <stdexcept>
 #include <string>
 #include <thread>
 #include <type_traits>
+#include <utility>
 
 #include <boost/atomic.hpp>
 #include <boost/interprocess/detail/os_thread_functions.hpp>
@@ -70,6 +78,8 @@ using std::function;
 using std::list;
 using std::map;
 using std::mutex;
+using std::pair;
+using std::shared_ptr;
 using std::string;
 using std::thread;
 using std::vector;
@@ -160,6 +170,17 @@ struct Process_descriptor
 static inline uint32_t s_branch_index = -1;
 
 
+// In mesh mode, every process reads the rings of every other process directly, and the
+// coordinator does not relay anything, which is otherwise how messages reach processes other
+// than the coordinator's. Traffic is then copied once instead of twice, and it does not
+// funnel through the reader threads of the coordinator, at the cost of every process having
+// a pair of reader threads per process of the swarm. The coordinator remains responsible for
+// naming, groups, barriers and the lifecycle of the processes.
+// It is enabled in the starter process with enable_mesh(), before init(), and passed on to
+// the spawned processes with --mesh_peers.
+static inline bool s_mesh = false;
+
+
 template <typename T>
 sintra::type_id_type get_type_id();
 
@@ -192,6 +213,56 @@ struct Managed_process: Derived_transceiver<Managed_process>
     Message_ring_W*                     m_out_req_c = nullptr;
     Message_ring_W*                     m_out_rep_c = nullptr;
 
+    // Only used in the process of the coordinator. RPC requests and replies relayed to a
+    // specific process are written to a pair of rings read only by that process (its lanes),
+    // rather than to the coordinator's rings, which are read by all processes. The lanes are
+    // created for each process spawned by branch(), and indexed by process index.
+    Message_ring_W*                     m_req_lanes[max_process_index + 1] = {};
+    Message_ring_W*                     m_rep_lanes[max_process_index + 1] = {};
+
+    // Returns the ring through which a request (or reply) addressed to the specified receiver
+    // is relayed, which is its lane if it has one.
+    Message_ring_W* relay_ring(instance_id_type receiver_instance_id, bool reply)
+    {
+        auto p = get_process_index(receiver_instance_id);
+        auto lane = p <= max_process_index ? (reply ? m_rep_lanes : m_req_lanes)[p] : nullptr;
+        return lane ? lane : (reply ? m_out_rep_c : m_out_req_c);
+    }
+
+    inline
+    void create_lanes(instance_id_type process_iid);
+
+    inline
+    void destroy_lanes(instance_id_type process_iid);
+
+    // Relays a request read from the specified reader's ring, by reference if it is large
+    // enough (see Message_ring_W::relay_by_reference()), otherwise by copy.
+    inline
+    void relay_request(Message_ring_W* ring, const Message_prefix& m, Message_ring_R& source);
+
+    // Only used in the process of the coordinator. The requests relayed by reference keep
+    // their octiles pinned in the rings of their senders, until they are read from the ring
+    // they were relayed to. The pins are released by a dedicated thread, rather than by the
+    // readers that relay, because a reader may sleep on a ring whose writer is blocked by
+    // a pin, which is only released once another ring has been read.
+    inline
+    void relay_pin_reaper_function();
+
+    inline
+    void wake_relay_pin_reaper();
+
+    thread                              m_relay_pin_reaper;
+    mutex                               m_relay_pin_reaper_mutex;
+    condition_variable                  m_relay_pin_reaper_condition;
+    atomic<bool>                        m_relay_pins_pending = false;
+    bool                                m_relay_pin_reaper_stopping = false;
+
+    // The request rings of other processes, mapped read-only, to read the messages relayed by
+    // reference, by process index. As with the blob pools, they are looked up without locking,
+    // and the mutex is only taken to attach. See get_relay_source()
+    atomic<Ring_data<char, true>*>      m_relay_sources[max_process_index + 1] = {};
+    mutex                               m_relay_sources_mutex;
+
     spinlocked_umap<
         string,
         type_id_type
@@ -266,9 +337,32 @@ struct Managed_process: Derived_transceiver<Managed_process>
 
     void flush(instance_id_type process_id, sequence_counter_type flush_sequence);
 
+    // In mesh mode, flushes the rings of all the other processes, up to what has been
+    // written to them so far.
+    void flush_peers();
+
 
     size_t unblock_rpc(instance_id_type process_instance_id = invalid_instance_id);
 
+    // Fails an asynchronous call (see rpc_async()) that is still waiting for its reply, as if
+    // the process of the callee had crashed, which releases its return handler.
+    // Returns false if the call has already completed.
+    bool abort_rpc(instance_id_type function_instance_id);
+
+
+    // The streams being written by the transceivers of this process, keyed by their caller
+    // and the function instance id of their call. See rpc_stream.h
+    map<
+        pair<instance_id_type, instance_id_type>,
+        shared_ptr<Outgoing_rpc_stream>
+    >                                   m_rpc_streams;
+    mutex                               m_rpc_streams_mutex;
+
+    // Ends the streams written by the specified callee, or read by the specified process,
+    // once either of them is gone. The callers of the former are written an exception.
+    inline
+    void abandon_rpc_streams(instance_id_type callee_iid, instance_id_type caller_process_iid);
+
 
     // This signal will be sent BEFORE the coordinator sends instance_unpublished
     // for this process. It is meant to notify crash guards about the reason of the
@@ -290,11 +384,44 @@ struct Managed_process: Derived_transceiver<Managed_process>
     function<void()> call_on_availability(Named_instance<T> transceiver, function<void()> f);
 
 
-    deque<sequence_counter_type>        m_flush_sequence;
-    mutex                               m_flush_sequence_mutex;
-    condition_variable                  m_flush_sequence_condition;
+    // The blob pool of this process, which holds payloads too large to be copied into the
+    // rings, and the pools of other processes that were attached for reading, indexed by
+    // process index. Pools are looked up without locking, since every payload in a blob is
+    // accessed through them (see variable_buffer::data()). The mutex is only taken to attach.
+    Blob_pool*                          m_blob_pool = nullptr;
+    atomic<Blob_pool*>                  m_blob_pools[max_process_index + 1] = {};
+    mutex                               m_blob_pools_mutex;
+
+    // The message types each process of the swarm has handlers for, which determine the
+    // events the coordinator relays. See interest_map.h
+    Interest_map*                       m_interest_map = nullptr;
+
+    // The swarm-wide shared arena, which is mapped on first use.
+    Shared_arena& arena();
+    Shared_arena*                       m_arena = nullptr;
+    mutex                               m_arena_mutex;
 
     handler_registry_type               m_active_handlers;
+    batch_handler_registry_type         m_active_batch_handlers;
+
+    // The lock-free view of m_active_handlers, used by the readers. See handler_dispatch.h
+    Handler_dispatch                    m_handler_dispatch;
+
+    // Delivers an event sent to any_local or any_local_or_remote to the handlers of this
+    // process, without passing it through the rings. See local_events.h
+    inline void deliver_locally(Local_message* lm);
+
+    // Calls the handlers of this process that accept the specified local event.
+    inline void dispatch_local(Message_prefix& m);
+
+    atomic<Local_delivery>              m_local_delivery = Local_delivery::queued;
+    Local_event_queue                   m_local_events{m_handler_dispatch,
+                                            [this](Message_prefix& m) { dispatch_local(m); }};
+
+    // Publishes the current handlers of the specified message type to the readers.
+    // Must be called with m_handlers_mutex locked, after each change in m_active_handlers or
+    // m_active_batch_handlers.
+    inline void publish_handlers(type_id_type message_type_id);
 
     // standard process groups
     instance_id_type                    m_group_all      = invalid_instance_id;
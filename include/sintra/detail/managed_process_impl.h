@@ -31,6 +31,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <chrono>
 #include <mutex>
+#include <sstream>
 
 #include <boost/lexical_cast.hpp>
 
@@ -168,13 +169,30 @@ Managed_process::~Managed_process()
 
     assert(m_state <= PAUSED); // i.e. paused or stopped
 
+    // the thread dispatching local events must be gone before anything is torn down
+    m_local_events.stop();
+
     // this is called explicitly, in order to inform the coordinator of the destruction early.
     // it would not be possible to communicate it after the channels were closed.
     this->Derived_transceiver<Managed_process>::destroy();
 
+    if (m_relay_pin_reaper.joinable()) {
+        {
+            lock_guard<mutex> lock(m_relay_pin_reaper_mutex);
+            m_relay_pin_reaper_stopping = true;
+            m_relay_pin_reaper_condition.notify_one();
+        }
+        m_relay_pin_reaper.join();
+    }
+
     // no more reading
     m_readers.clear();
 
+    // the readers released any pins of the messages relayed by reference
+    for (auto& r : m_relay_sources) {
+        delete r.exchange(nullptr);
+    }
+
     // no more writing
     if (m_out_req_c) {
         delete m_out_req_c;
@@ -186,6 +204,29 @@ Managed_process::~Managed_process()
         m_out_rep_c = nullptr;
     }
 
+    for (int i = 0; i <= max_process_index; i++) {
+        delete m_req_lanes[i];
+        delete m_rep_lanes[i];
+        m_req_lanes[i] = m_rep_lanes[i] = nullptr;
+    }
+
+    // with the rings gone, there are no references to any blobs
+    for (auto& p : m_blob_pools) {
+        delete p.exchange(nullptr);
+    }
+
+    delete m_blob_pool;
+    m_blob_pool = nullptr;
+
+    if (m_interest_map) {
+        m_interest_map->clear(m_instance_id);
+        delete m_interest_map;
+        m_interest_map = nullptr;
+    }
+
+    delete m_arena;
+    m_arena = nullptr;
+
     if (s_coord) {
 
         // now it's safe to delete the Coordinator.
@@ -211,6 +252,7 @@ void Managed_process::init(int argc, char* argv[])
     std::string swarm_id_arg;
     std::string instance_id_arg;
     std::string coordinator_id_arg;
+    std::string mesh_peers_arg;
 
     try {
         while (true) {
@@ -220,11 +262,12 @@ void Managed_process::init(int argc, char* argv[])
                 {"swarm_id",        required_argument,  0,          'b' },
                 {"instance_id",     required_argument,  0,          'c' },
                 {"coordinator_id",  required_argument,  0,          'd' },
+                {"mesh_peers",      required_argument,  0,          'e' },
                 {0, 0, 0, 0}
             };
 
             int option_index = 0;
-            int c = getopt_long(argc, argv, "ha:b:c:d:", long_options, &option_index);
+            int c = getopt_long(argc, argv, "ha:b:c:d:e:", long_options, &option_index);
 
             if (c == -1)
                 break;
@@ -253,6 +296,10 @@ void Managed_process::init(int argc, char* argv[])
                     coordinator_id_arg  = optarg;
                     s_coord_id         = boost::lexical_cast<decltype(s_coord_id    )>(optarg);
                     break;
+                case 'e':
+                    mesh_peers_arg      = optarg;
+                    s_mesh              = true;
+                    break;
                 case '?':
                     /* getopt_long already printed an error message. */
                     break;
@@ -272,6 +319,8 @@ Managed process options:
                         the supervisor
   --coordinator_id arg  the instance id of the coordinator that this process
                         should refer to
+  --mesh_peers arg      comma separated instance ids of the processes whose rings
+                        this process should read directly (mesh mode)
 )";
         exit(1);
     }
@@ -312,10 +361,15 @@ Managed process options:
     }
     m_directory = obtain_swarm_directory();
 
+    m_blob_pool = new Blob_pool(m_directory, m_instance_id, true);
+    m_interest_map = new Interest_map(m_directory, coordinator_is_local);
+
     m_out_req_c = new Message_ring_W(m_directory, "req", m_instance_id);
     m_out_rep_c = new Message_ring_W(m_directory, "rep", m_instance_id);
 
     if (coordinator_is_local) {
+        m_relay_pin_reaper = thread([this]() { relay_pin_reaper_function(); });
+
         s_coord = new Coordinator;
         s_coord_id = s_coord->m_instance_id;
 
@@ -330,6 +384,32 @@ Managed process options:
     assert(it.second == true);
     it.first->second.wait_until_ready();
 
+    if (!coordinator_is_local && s_mesh) {
+        // the rings of the other processes, which were created by the coordinator before any
+        // process was spawned, unless the spawn failed.
+        std::istringstream peers(mesh_peers_arg);
+        string peer;
+        while (std::getline(peers, peer, ',')) {
+            auto piid = boost::lexical_cast<instance_id_type>(peer);
+            if (piid == m_instance_id || m_readers.count(piid)) {
+                continue;
+            }
+            try {
+                m_readers.emplace(piid, piid).first->second.wait_until_ready();
+            }
+            catch (ring_acquisition_failure_exception&) {
+            }
+        }
+    }
+    else
+    if (!coordinator_is_local) {
+        // the lanes through which the coordinator relays requests and replies to this process
+        auto lit = m_readers.emplace(std::piecewise_construct,
+            std::forward_as_tuple(m_instance_id), std::forward_as_tuple(m_instance_id, true));
+        assert(lit.second == true);
+        lit.first->second.wait_until_ready();
+    }
+
     // Up to this point, there was no infrastructure for a proper construction
     // of Transceiver base.
 
@@ -371,6 +451,7 @@ Managed process options:
             }
 
             s_mproc->unblock_rpc(iid);
+            s_mproc->abandon_rpc_streams(invalid_instance_id, iid);
         }
 
         // if the unpublished transceiver is the coordinator process, we have to stop.
@@ -439,8 +520,38 @@ bool Managed_process::branch(vector<Process_descriptor>& branch_vector)
             it->sintra_options.push_back(to_string(s_coord_id));
         }
 
+        // in mesh mode, each process reads the rings of all the others
+        if (s_mesh) {
+            string peers;
+            for (auto& pd : branch_vector) {
+                peers += (peers.empty() ? "" : ",") + to_string(pd.assigned_instance_id);
+            }
+            for (auto& pd : branch_vector) {
+                pd.sintra_options.push_back("--mesh_peers");
+                pd.sintra_options.push_back(peers);
+            }
+        }
+
+
+        // 2. create the readers, before any process is spawned, so that the rings of all
+        // processes exist by the time any of them is started.
+        for (auto& pd : branch_vector) {
+            assert(!m_readers.count(process_of(pd.assigned_instance_id)));
+            auto eit = m_readers.emplace(pd.assigned_instance_id, pd.assigned_instance_id);
+            assert(eit.second == true);
+
+            // lanes are pointless in mesh mode, since nothing is relayed
+            if (!s_mesh) {
+                create_lanes(pd.assigned_instance_id);
+            }
+
+            // Before spawning the new process, we have to assure that the
+            // corresponding reading threads are up and running.
+            eit.first->second.wait_until_ready();
+        }
+
 
-        // 2. spawn
+        // 3. spawn
         std::unordered_set<instance_id_type> successfully_spawned;
         it = branch_vector.begin();
         //auto readers_it = m_readers.begin();
@@ -455,13 +566,6 @@ bool Managed_process::branch(vector<Process_descriptor>& branch_vector)
                 argv[i] = all_args[i].c_str();
             }
             argv[all_args.size()] = 0;
-            assert(!m_readers.count(process_of(it->assigned_instance_id)));
-            auto eit = m_readers.emplace(it->assigned_instance_id, it->assigned_instance_id);
-            assert(eit.second == true);
-
-            // Before spawning the new process, we have to assure that the
-            // corresponding reading threads are up and running.
-            eit.first->second.wait_until_ready();
 
             bool success = spawn_detached(it->entry.m_binary_name.c_str(), argv);
             if (!success) {
@@ -470,6 +574,7 @@ bool Managed_process::branch(vector<Process_descriptor>& branch_vector)
 
                 //m_readers.pop_back();
                 m_readers.erase(it->assigned_instance_id);
+                destroy_lanes(it->assigned_instance_id);
             }
             else {
                 successfully_spawned.insert(it->assigned_instance_id);
@@ -517,13 +622,17 @@ bool Managed_process::branch(vector<Process_descriptor>& branch_vector)
         // the supervisor, which is its own coordinator, will do that too (loop comm)
         //m_peers->read_from(m_coordinator_id);
 
+        // waiting for the other processes to start is not subject to timeouts
+        Rpc_timeout timeout(0.);
+
         m_group_all      = Coordinator::rpc_wait_for_instance(s_coord_id, "_sintra_all_processes");
         m_group_external = Coordinator::rpc_wait_for_instance(s_coord_id, "_sintra_external_processes");
 
     }
 
     // assign_name requires that all processes are instantiated, in order
-    // to receive the instance_published event
+    // to receive the instance_published event. Like above, this is not subject to timeouts.
+    Rpc_timeout timeout(0.);
     bool all_started = Process_group::rpc_barrier(m_group_all, UIBS);
     if (!all_started) {
         return false;
@@ -692,6 +801,92 @@ void Managed_process::wait_until_all_external_readers_are_done()
 }
 
 
+inline
+void Managed_process::create_lanes(instance_id_type process_iid)
+{
+    auto p = get_process_index(process_iid);
+    assert(!m_req_lanes[p] && !m_rep_lanes[p]);
+    m_req_lanes[p] = new Message_ring_W(m_directory, "lreq", process_iid);
+    m_rep_lanes[p] = new Message_ring_W(m_directory, "lrep", process_iid);
+}
+
+
+inline
+void Managed_process::destroy_lanes(instance_id_type process_iid)
+{
+    auto p = get_process_index(process_iid);
+
+    // the lane will not be read, thus its pins are released regardless
+    lock_guard<mutex> lock(m_relay_pin_reaper_mutex);
+    if (m_req_lanes[p]) {
+        m_req_lanes[p]->drop_relay_pins();
+    }
+    delete m_req_lanes[p];
+    delete m_rep_lanes[p];
+    m_req_lanes[p] = m_rep_lanes[p] = nullptr;
+}
+
+
+inline
+void Managed_process::relay_request(
+    Message_ring_W* ring, const Message_prefix& m, Message_ring_R& source)
+{
+    if (m.bytes_to_next_message >= relay_by_reference_threshold &&
+        ring->relay_by_reference(m, source))
+    {
+        wake_relay_pin_reaper();
+        return;
+    }
+    ring->relay(m);
+}
+
+
+inline
+void Managed_process::wake_relay_pin_reaper()
+{
+    if (!m_relay_pins_pending.exchange(true)) {
+        lock_guard<mutex> lock(m_relay_pin_reaper_mutex);
+        m_relay_pin_reaper_condition.notify_one();
+    }
+}
+
+
+inline
+void Managed_process::relay_pin_reaper_function()
+{
+    unique_lock<mutex> lock(m_relay_pin_reaper_mutex);
+    while (true) {
+        m_relay_pin_reaper_condition.wait(lock, [&]() {
+            return m_relay_pins_pending.load() || m_relay_pin_reaper_stopping;
+        });
+        if (m_relay_pin_reaper_stopping) {
+            return;
+        }
+
+        // Cleared before scanning, thus a message relayed during the scan will either be
+        // seen by it, or cause another one.
+        m_relay_pins_pending = false;
+
+        while (!m_relay_pin_reaper_stopping) {
+            size_t num_pinned = m_out_req_c->release_relay_pins();
+            for (auto lane : m_req_lanes) {
+                if (lane) {
+                    num_pinned += lane->release_relay_pins();
+                }
+            }
+            if (!num_pinned) {
+                break;
+            }
+
+            // the readers are expected to be past the descriptors shortly
+            lock.unlock();
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            lock.lock();
+        }
+    }
+}
+
+
 inline
 void Managed_process::flush(instance_id_type process_id, sequence_counter_type flush_sequence)
 {
@@ -703,15 +898,16 @@ void Managed_process::flush(instance_id_type process_id, sequence_counter_type f
             "attempted to flush the channel of a process which is not being read"
         );
     }
-    auto& reader = it->second;
-    auto rs = reader.get_request_reading_sequence();
-    if (rs < flush_sequence) {
-        std::unique_lock<mutex> flush_lock(m_flush_sequence_mutex);
-        m_flush_sequence.push_back(flush_sequence);
-        while (!m_flush_sequence.empty() &&
-            m_flush_sequence.front() <= flush_sequence)
-        {
-            m_flush_sequence_condition.wait(flush_lock);
+    it->second.flush(flush_sequence);
+}
+
+
+inline
+void Managed_process::flush_peers()
+{
+    for (auto& r : m_readers) {
+        if (r.first != process_of(s_coord_id) && r.first != m_instance_id) {
+            r.second.flush(r.second.get_request_leading_sequence());
         }
     }
 }
@@ -722,23 +918,190 @@ size_t Managed_process::unblock_rpc(instance_id_type process_instance_id)
 {
     assert(!process_instance_id || is_process(process_instance_id));
     size_t ret = 0;
-    unique_lock<mutex> ol(s_outstanding_rpcs_mutex);
-    if (!s_outstanding_rpcs.empty()) {
 
-        for (auto& c : s_outstanding_rpcs) {
-            unique_lock<mutex> il(c->keep_waiting_mutex);
+    if (process_instance_id == invalid_instance_id) {
+        return ret;
+    }
+
+    // all RPC calls of the process are made on behalf of the managed process
+    m_return_handlers.for_each([&](const Return_handler& rh) {
+        if (process_of(rh.instance_id) == process_instance_id) {
+            rh.abort_handler(rh.context);
+            ret++;
+        }
+    });
+    return ret;
+}
+
 
-            if (process_instance_id != invalid_instance_id &&
-                process_of(c->remote_instance) == process_instance_id)
+
+inline
+bool Managed_process::abort_rpc(instance_id_type function_instance_id)
+{
+    return m_return_handlers.invoke(function_instance_id, [](const Return_handler& rh) {
+        rh.abort_handler(rh.context);
+    });
+}
+
+
+
+inline
+void Managed_process::abandon_rpc_streams(
+    instance_id_type callee_iid, instance_id_type caller_process_iid)
+{
+    vector<shared_ptr<Outgoing_rpc_stream>> abandoned;
+    {
+        lock_guard<mutex> lock(m_rpc_streams_mutex);
+        for (auto it = m_rpc_streams.begin(); it != m_rpc_streams.end();) {
+            if (it->second->callee_iid == callee_iid ||
+                process_of(it->second->caller_iid) == caller_process_iid)
             {
-                c->success = false;
-                c->keep_waiting = false;
-                c->keep_waiting_condition.notify_one();
-                ret++;
+                abandoned.push_back(it->second);
+                it = m_rpc_streams.erase(it);
+            }
+            else {
+                ++it;
             }
         }
     }
-    return ret;
+
+    // the stream may be in the middle of a write, which is waited for
+    for (auto& os : abandoned) {
+        lock_guard<mutex> lock(os->m);
+        if (os->finished) {
+            continue;
+        }
+        os->finished = true;
+        if (os->callee_iid == callee_iid) {
+            os->write_failure("The instance writing the stream was destroyed.");
+        }
+        os->write_next = nullptr;
+        os->write_failure = nullptr;
+    }
+}
+
+
+
+inline
+void Managed_process::publish_handlers(type_id_type message_type_id)
+{
+    auto record = std::make_shared<Dispatch_snapshot::type_record_type>();
+
+    // specific senders first, then the wildcards, in the order they are looked up
+    auto append = [&](auto& registry, auto make_entry) {
+        auto it = registry.find(message_type_id);
+        if (it == registry.end()) {
+            return;
+        }
+        for (auto& e : it->second) {
+            if (e.first != any_remote && e.first != any_local_or_remote) {
+                for (auto& h : e.second) {
+                    record->push_back(make_entry(e.first, h));
+                }
+            }
+        }
+        for (auto sender : {any_remote, any_local_or_remote}) {
+            auto it2 = it->second.find(sender);
+            if (it2 != it->second.end()) {
+                for (auto& h : it2->second) {
+                    record->push_back(make_entry(sender, h));
+                }
+            }
+        }
+    };
+
+    using entry_type = Dispatch_snapshot::Entry;
+    append(m_active_handlers, [](instance_id_type sender, auto& h) {
+        return entry_type{sender, h, nullptr};
+    });
+    append(m_active_batch_handlers, [](instance_id_type sender, auto& h) {
+        return entry_type{sender, nullptr, h};
+    });
+
+    if (record->empty()) {
+        record = nullptr;
+    }
+
+    // handlers of local senders do not depend on the relay of the coordinator
+    bool interested = record && std::any_of(record->begin(), record->end(),
+        [](const entry_type& e) { return !is_local_instance(e.sender); });
+    if (m_interest_map) {
+        m_interest_map->set(m_instance_id, message_type_id, interested);
+    }
+
+    m_handler_dispatch.publish(message_type_id, std::move(record));
+}
+
+
+inline
+void Managed_process::deliver_locally(Local_message* lm)
+{
+    if (m_local_delivery == Local_delivery::queued) {
+        m_local_events.push(lm);
+        return;
+    }
+
+    dispatch_local(*lm->message);
+    Local_message::free(lm);
+}
+
+
+inline
+void Managed_process::dispatch_local(Message_prefix& m)
+{
+    // same as with the readers, a paused process only handles what the coordinator handles
+    if (m_state != RUNNING &&
+        !(s_coord && m.message_type_id > (type_id_type)detail::reserved_id::base_of_messages_handled_by_coordinator))
+    {
+        return;
+    }
+
+    Handler_dispatch::Read_guard snapshot(m_handler_dispatch);
+
+    auto record = snapshot->find(m.message_type_id);
+    if (!record) {
+        return;
+    }
+
+    auto previous_message = s_tl_current_message;
+    s_tl_current_message = &m;
+
+    for (auto& e : *record) {
+        if (e.sender == m.sender_instance_id ||
+            e.sender == any_local ||
+            e.sender == any_local_or_remote)
+        {
+            if (e.handler) {
+                e.handler(m);
+            }
+            else {
+                Message_prefix* batch[] = {&m};
+                e.batch_handler(batch, 1);
+            }
+        }
+    }
+
+    s_tl_current_message = previous_message;
+}
+
+
+
+inline
+Shared_arena& Managed_process::arena()
+{
+    lock_guard<mutex> lock(m_arena_mutex);
+    if (!m_arena) {
+        m_arena = new Shared_arena(m_directory);
+    }
+    return *m_arena;
+}
+
+
+template <typename T>
+template <typename>
+T* Arena_handle<T>::get() const
+{
+    return s_mproc->arena().resolve(*this);
 }
 
 
@@ -26,12 +26,18 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef SINTRA_MESSAGE_H
 #define SINTRA_MESSAGE_H
 
+#include "blob_pool.h"
 #include "id_types.h"
 #include "ipc_rings.h"
 #include "utility.h"
 
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
+#include <deque>
+#include <initializer_list>
 #include <type_traits>
+#include <vector>
 
 #include <boost/fusion/container/vector.hpp>
 #include <boost/type_index.hpp>
@@ -41,12 +47,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 namespace sintra {
 
 
+using std::deque;
 using std::enable_if_t;
 using std::is_base_of;
 using std::is_convertible;
 using std::is_pod;
 using std::is_same;
 using std::remove_reference;
+using std::vector;
 
 
 constexpr uint64_t  message_magic        = 0xc18a1aca1ebac17a;
@@ -61,6 +69,26 @@ constexpr int       message_ring_size    = 0x200000;
   //       \//       \//       \//       \//       \//       \//       \//
 
 
+// The alignment of the payload of a variable buffer initialized from a container of type T,
+// within the ring. By default, payloads are packed right after the message, and they may have
+// any alignment. It can be specialized to allow vectorized processing of the payload in place,
+// e.g.
+//
+// template <> struct sintra::vb_alignment<std::vector<float>> { static constexpr size_t value = 32; };
+//
+// When a message has payloads that should be aligned, the message itself is aligned to the
+// strictest of them, and all of its payloads are aligned alike.
+template <typename T>
+struct vb_alignment
+{
+    static constexpr size_t value = 1;
+};
+
+
+// Blobs are aligned to this, thus it is the strictest alignment a payload may have.
+constexpr size_t max_vb_alignment = 64;
+
+
 // This type only lives inside ring buffers.
 struct variable_buffer
 {
@@ -70,16 +98,52 @@ struct variable_buffer
     // this is set by the message constructor
     size_t offset_in_bytes = 0;
 
+    // If the payload was spilled to a blob pool, these identify the process owning the pool
+    // and the blob. Otherwise, blob_offset is 0 and the payload follows the message.
+    instance_id_type blob_owner = invalid_instance_id;
+    uint64_t blob_offset = 0;
+
+    struct Blob_reservation
+    {
+        size_t      num_bytes;
+        uint64_t    offset;
+    };
+
+    static constexpr size_t max_reserved_blobs = 16;
+
     template <typename = void>
     struct Statics
     {
         thread_local static char*        tl_message_start_address;
         thread_local static uint32_t*    tl_pbytes_to_next_message;
+
+        // Blobs reserved by vb_size(), which are consumed in the same order by the variable
+        // buffers of the message constructed right after.
+        thread_local static Blob_reservation tl_reserved_blobs[max_reserved_blobs];
+        thread_local static size_t       tl_num_reserved_blobs;
+        thread_local static size_t       tl_next_reserved_blob;
+
+        // Set by vb_size(), for the payloads that will be written into the ring. When the
+        // message is written, tl_payload_alignment is adjusted to the alignment of the message
+        // type, and it is used by the variable buffers of the message.
+        thread_local static size_t       tl_payload_alignment;
+        thread_local static size_t       tl_num_payloads;
     };
     using S = Statics<void>;
 
     bool empty() const { return num_bytes == 0; }
 
+    // The address of the payload, wherever it resides.
+    inline const char* data() const;
+
+    // Called by vb_size() for each variable buffer of a message that is about to be written.
+    // If the payload is large enough to be spilled and a blob could be allocated, it returns
+    // true, meaning that the payload will not take any space in the ring.
+    static inline bool reserve_blob(size_t num_bytes);
+
+    // Releases any reserved blobs that were not consumed by the message constructor.
+    static inline void release_unused_blobs();
+
     variable_buffer() {}
 
     variable_buffer(const variable_buffer& v)
@@ -89,11 +153,39 @@ struct variable_buffer
 
     template <typename TC, typename T = typename TC::iterator::value_type>
     variable_buffer(const TC& container);
+
+protected:
+
+    // Sets up the destination of a payload of num_bytes (which must be set first), while the
+    // message is being constructed. This is either a blob reserved by vb_size(), or the space
+    // right after the message in the ring (aligned to tl_payload_alignment). Returns the address
+    // the payload should be written to.
+    inline char* allocate_payload();
+
+public:
+
+    // Accounts for a payload that will be written into the ring, in vb_size().
+    template <typename T>
+    static void count_payload()
+    {
+        static_assert(vb_alignment<T>::value <= max_vb_alignment &&
+            (vb_alignment<T>::value & (vb_alignment<T>::value - 1)) == 0,
+            "vb_alignment must be a power of 2, not exceeding max_vb_alignment");
+
+        S::tl_num_payloads++;
+        S::tl_payload_alignment = std::max(S::tl_payload_alignment, vb_alignment<T>::value);
+    }
 };
 
 
 template <> thread_local char*      variable_buffer::S::tl_message_start_address    = nullptr;
 template <> thread_local uint32_t*  variable_buffer::S::tl_pbytes_to_next_message   = nullptr;
+template <> thread_local variable_buffer::Blob_reservation
+    variable_buffer::S::tl_reserved_blobs[variable_buffer::max_reserved_blobs]          = {};
+template <> thread_local size_t     variable_buffer::S::tl_num_reserved_blobs       = 0;
+template <> thread_local size_t     variable_buffer::S::tl_next_reserved_blob       = 0;
+template <> thread_local size_t     variable_buffer::S::tl_payload_alignment        = 1;
+template <> thread_local size_t     variable_buffer::S::tl_num_payloads             = 0;
 
 
 template <typename T>
@@ -105,10 +197,10 @@ public:
     template <typename CT = typename T::iterator::value_type>
     operator T() const
     {
-        assert(offset_in_bytes);
+        assert(offset_in_bytes || blob_offset);
         assert((num_bytes % sizeof(CT)) == 0);
 
-        CT* typed_data = (CT*)((char*)this+offset_in_bytes);
+        CT* typed_data = (CT*)data();
         size_t num_elements = num_bytes / sizeof(CT);
         return T(typed_data, typed_data + num_elements);
     }
@@ -165,14 +257,129 @@ template <
 >
 size_t vb_size(const T& v, Args&&... args)
 {
-    auto ret = v.size() * sizeof(typename T::iterator::value_type) + vb_size(args...);
-    return ret;
+    size_t num_bytes = v.size() * sizeof(typename T::iterator::value_type);
+
+    // the reservation must precede the ones of the following arguments
+    if (variable_buffer::reserve_blob(num_bytes)) {
+        num_bytes = 0;
+    }
+    else {
+        variable_buffer::count_payload<T>();
+    }
+    return num_bytes + vb_size(args...);
 }
 
 
 using message_string = typed_variable_buffer<string>;
 
 
+
+// A payload assembled from several separate buffers. The segments are copied straight into
+// the message, in order, which saves concatenating them into a temporary container before
+// sending. A message field of type message_gather is initialized from a gather_list.
+struct gather_list
+{
+    gather_list() {}
+
+    gather_list(std::initializer_list<Range<const char>> segments):
+        segments(segments)
+    {}
+
+    gather_list& add(const void* data, size_t num_bytes)
+    {
+        segments.push_back({(const char*)data, (const char*)data + num_bytes});
+        return *this;
+    }
+
+    // Adds the contents of a contiguous container (e.g. vector or string).
+    template <typename TC, typename T = typename TC::value_type>
+    gather_list& add(const TC& container)
+    {
+        return add(container.data(), container.size() * sizeof(T));
+    }
+
+    // Adds the bytes of a trivially copyable object.
+    template <typename T>
+    gather_list& add_object(const T& object)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "The object cannot be copied bytewise.");
+        return add(&object, sizeof(T));
+    }
+
+    // The size of the payload of a message_gather initialized with this list.
+    size_t payload_size() const
+    {
+        size_t ret = sizeof(uint64_t) * (1 + segments.size());
+        for (auto& s : segments) {
+            ret += s.end - s.begin;
+        }
+        return ret;
+    }
+
+    vector<Range<const char>> segments;
+};
+
+
+// The payload starts with a table of the number of segments and their sizes, followed by
+// the contents of the segments. The payload is not aligned (it follows the preceding payloads
+// of the message), thus the entries of the table are copied, rather than dereferenced.
+struct message_gather: protected variable_buffer
+{
+    message_gather() {}
+    inline message_gather(const gather_list& list);
+
+    size_t num_segments() const { return (size_t)table_entry(0); }
+
+    Range<const char> segment(size_t index) const
+    {
+        assert(index < num_segments());
+        const char* begin = segments_begin();
+        for (size_t i = 0; i < index; i++) {
+            begin += table_entry(1 + i);
+        }
+        return {begin, begin + table_entry(1 + index)};
+    }
+
+    // The total size of the segments, excluding the table.
+    size_t size() const { return num_bytes - sizeof(uint64_t) * (1 + num_segments()); }
+
+    // The segments, concatenated.
+    operator vector<char>() const
+    {
+        const char* begin = segments_begin();
+        return vector<char>(begin, begin + size());
+    }
+
+private:
+    uint64_t table_entry(size_t index) const
+    {
+        assert(offset_in_bytes || blob_offset);
+        uint64_t ret;
+        memcpy(&ret, data() + sizeof(uint64_t) * index, sizeof(ret));
+        return ret;
+    }
+
+    const char* segments_begin() const
+    {
+        return data() + sizeof(uint64_t) * (1 + num_segments());
+    }
+};
+
+
+template <typename... Args>
+size_t vb_size(const gather_list& list, Args&&... args)
+{
+    size_t num_bytes = list.payload_size();
+    if (variable_buffer::reserve_blob(num_bytes)) {
+        num_bytes = 0;
+    }
+    else {
+        variable_buffer::count_payload<gather_list>();
+    }
+    return num_bytes + vb_size(args...);
+}
+
+
   //\       //\       //\       //\       //\       //\       //\       //
  ////\     ////\     ////\     ////\     ////\     ////\     ////\     ////
 //////\   //////\   //////\   //////\   //////\   //////\   //////\   //////
@@ -226,6 +433,13 @@ struct transformer<T, false, true>
 };
 
 
+template <>
+struct transformer<gather_list, false, false>
+{
+    using type = message_gather;
+};
+
+
 template <typename SEQ_T, int I, int J, typename... Args>
 struct serializable_type_impl;
 
@@ -303,6 +517,10 @@ struct Message_prefix
     // used by the serializer, set in constructor
     uint32_t bytes_to_next_message          = 0;
 
+    // If nonzero, the message starts at an address aligned to this, which must be preserved
+    // when it is relayed. This is set by the ring, when the message is written.
+    uint32_t alignment                      = 0;
+
     union {
         // This is a cross-process type id. It is set in message constructor.
         type_id_type message_type_id        = invalid_type_id;
@@ -320,6 +538,10 @@ struct Message_prefix
 
     // used by the serializer, set in communicators
     instance_id_type receiver_instance_id   = invalid_instance_id;
+
+    // The offset of the first blob referenced by the message, in the blob pool of the sender's
+    // process, or 0 if the message does not reference any blobs. See blob_pool.h
+    uint64_t blob_chain                     = 0;
 };
 
 template <typename T>
@@ -380,6 +602,7 @@ struct Message: public Message_prefix, public T
 
         variable_buffer::S::tl_message_start_address = nullptr;
         variable_buffer::S::tl_pbytes_to_next_message = nullptr;
+        variable_buffer::release_unused_blobs();
 
         assert(bytes_to_next_message < (message_ring_size / 8));
 
@@ -471,7 +694,7 @@ struct Message: public Message_prefix, public T
 
 
 
-#define SINTRA_SIGNAL_BASE(name, idv, ...)                                      \
+#define SINTRA_SIGNAL_BASE(name, idv, body_attributes, ...)                     \
     void inheritance_assertion_##name() {                                       \
         static_assert(std::is_same_v<                                           \
             std::remove_pointer_t<decltype(this)>,                              \
@@ -479,15 +702,21 @@ struct Message: public Message_prefix, public T
             "This Transceiver is not derived correctly."                        \
         );                                                                      \
     }                                                                           \
-    _DEFINE_STRUCT(_sm_body_type_##name, __VA_ARGS__)                           \
+    _DEFINE_STRUCT(body_attributes _sm_body_type_##name, __VA_ARGS__)           \
     using name = Message<_sm_body_type_##name, void, idv, Transceiver_type>;    \
 
 
 #define SINTRA_SIGNAL(name, ...)                                                \
-    SINTRA_SIGNAL_BASE(name, invalid_type_id, __VA_ARGS__)
+    SINTRA_SIGNAL_BASE(name, invalid_type_id, , __VA_ARGS__)
+
+// The message, as well as its variable buffer payloads, will be aligned to the specified
+// alignment (at most max_vb_alignment) in the ring.
+#define SINTRA_SIGNAL_ALIGNED(name, alignment, ...)                             \
+    static_assert(alignment <= max_vb_alignment, "Unsupported alignment");      \
+    SINTRA_SIGNAL_BASE(name, invalid_type_id, alignas(alignment), __VA_ARGS__)
 
 #define SINTRA_SIGNAL_EXPLICIT(name, ...)                                       \
-    SINTRA_SIGNAL_BASE(name, (type_id_type)sintra::detail::reserved_id::name, __VA_ARGS__)
+    SINTRA_SIGNAL_BASE(name, (type_id_type)sintra::detail::reserved_id::name, , __VA_ARGS__)
 
 
 
@@ -599,6 +828,34 @@ std::string get_base_filename(const string& prefix, uint64_t id)
 }
 
 
+// True for an event that was sent from this process to any_local_or_remote. Such events are
+// delivered locally when they are sent (see local_events.h), thus the readers skip them when
+// they come back through the coordinator's ring.
+inline
+bool is_local_echo(const Message_prefix& m)
+{
+    return
+        m.receiver_instance_id == any_local_or_remote &&
+        process_of(m.sender_instance_id) == s_mproc_id;
+}
+
+
+
+// Stands for a message in the request ring of another process, which the coordinator relayed
+// by reference (see Message_ring_W::relay_by_reference()).
+struct Relay_descriptor: Message_prefix
+{
+    instance_id_type    source_process_iid;
+    uint64_t            offset;             // from the base address of the source ring
+};
+
+
+// Returns the base address of a read-only mapping of the request ring of the specified
+// process, mapping it if necessary, or nullptr if the ring does not exist.
+inline const char* get_relay_source(instance_id_type process_iid);
+
+
+
 struct Message_ring_R: Ring_R<char>
 {
     Message_ring_R(const string& directory, const string& prefix, uint64_t id):
@@ -615,10 +872,16 @@ struct Message_ring_R: Ring_R<char>
 
     // Returns a pointer to the buffer of the message
     // If there is no message to read, it blocks.
+    // Once request_stop() has been called, it returns nullptr at the end of the current range.
+    // This is only checked at range boundaries, thus iterating over a range takes plain loads.
     Message_prefix* fetch_message()
     {
         // if all the messages in the reading buffer have been read
         if (m_range.begin == m_range.end) {
+            if (m_stop_requested) {
+                return nullptr;
+            }
+
             // if this is not an uninitialized state
             if (m_reading) {
                 // finalize the reading
@@ -637,23 +900,54 @@ struct Message_ring_R: Ring_R<char>
             m_range = range;
         }
 
-        bool f = false;
-        while (!m_reading_lock.compare_exchange_strong(f, true)) { f = false; }
-
-        //m_reading_lock
-        if (!m_reading) {
-            m_reading_lock = false;
-            return nullptr;
-        }
-
         Message_prefix* ret = (Message_prefix*)m_range.begin;
         assert(ret->magic == message_magic);
         m_range.begin += ret->bytes_to_next_message;
 
-        m_reading_lock = false;
+        // padding is not a message, it only precedes an aligned one
+        if (ret->message_type_id == (type_id_type)detail::reserved_id::message_padding) {
+            return fetch_message();
+        }
+
+        if (ret->message_type_id == (type_id_type)detail::reserved_id::relayed_by_reference) {
+            auto d = (Relay_descriptor*)ret;
+            auto source = get_relay_source(d->source_process_iid);
+            if (!source) {
+                return fetch_message();
+            }
+            ret = (Message_prefix*)(source + d->offset);
+            assert(ret->magic == message_magic);
+        }
         return ret;
     }
 
+    // Takes the messages that follow the last one fetched, for as long as they are of the same
+    // type, addressed to the same receiver and of the same origin (see is_local_echo()) as the
+    // last message in 'run', to which they are appended. This does not go beyond the range that
+    // is currently being read, thus it never blocks.
+    void fetch_run(vector<Message_prefix*>& run)
+    {
+        assert(!run.empty());
+        auto last = run.back();
+
+        while (m_range.begin != m_range.end) {
+            auto next = (Message_prefix*)m_range.begin;
+            assert(next->magic == message_magic);
+
+            if (next->message_type_id != (type_id_type)detail::reserved_id::message_padding) {
+                if (next->message_type_id      != last->message_type_id      ||
+                    next->receiver_instance_id != last->receiver_instance_id ||
+                    is_local_echo(*next)       != is_local_echo(*last))
+                {
+                    break;
+                }
+                run.push_back(next);
+            }
+            m_range.begin += next->bytes_to_next_message;
+        }
+    }
+
+
     sequence_counter_type get_message_reading_sequence() const
     {
         return reading_sequence() - (m_range.end - m_range.begin);
@@ -669,6 +963,110 @@ protected:
 
 
 
+// A handle keeping a message in its ring after its handler has returned, which may be passed
+// to another thread, to process the message without copying it. The writer of the ring cannot
+// proceed beyond the octile of the message while it is retained, thus it should be released as
+// soon as possible. It must be released before the process is finalized. See retain().
+template <typename MESSAGE_T>
+class Retained_message
+{
+public:
+    Retained_message() {}
+
+    Retained_message(const MESSAGE_T* message, Ring_R<char>* ring, int octile):
+        m_message(message), m_ring(ring), m_octile(octile)
+    {}
+
+    Retained_message(Retained_message&& rhs)
+    {
+        *this = std::move(rhs);
+    }
+
+    Retained_message& operator=(Retained_message&& rhs)
+    {
+        if (this != &rhs) {
+            release();
+            std::swap(m_message, rhs.m_message);
+            std::swap(m_ring,    rhs.m_ring);
+            std::swap(m_octile,  rhs.m_octile);
+        }
+        return *this;
+    }
+
+    Retained_message(const Retained_message&) = delete;
+    Retained_message& operator=(const Retained_message&) = delete;
+
+    ~Retained_message()
+    {
+        release();
+    }
+
+    // false if the message could not be retained (see max_retained_messages), in which case
+    // it should be copied, if it is needed beyond its handler.
+    explicit operator bool() const { return m_message != nullptr; }
+
+    const MESSAGE_T& operator*()  const { return *m_message; }
+    const MESSAGE_T* operator->() const { return  m_message; }
+    const MESSAGE_T* get()        const { return  m_message; }
+
+    void release()
+    {
+        if (m_message) {
+            m_ring->unpin(m_octile);
+            m_message = nullptr;
+            m_ring = nullptr;
+            m_octile = -1;
+        }
+    }
+
+private:
+    const MESSAGE_T*    m_message   = nullptr;
+    Ring_R<char>*       m_ring      = nullptr;
+    int                 m_octile    = -1;
+};
+
+
+
+// The consecutive messages of one type, which were read together from a ring, as passed to
+// the slots activated with activate_batch(). The messages are only valid for the duration of
+// the call, unless held (see hold()).
+template <typename MESSAGE_T>
+struct Message_batch
+{
+    using message_type = MESSAGE_T;
+
+    struct iterator
+    {
+        const MESSAGE_T& operator*()  const { return *(const MESSAGE_T*)*m_p; }
+        const MESSAGE_T* operator->() const { return  (const MESSAGE_T*)*m_p; }
+        iterator& operator++() { ++m_p; return *this; }
+        bool operator==(const iterator& rhs) const { return m_p == rhs.m_p; }
+        bool operator!=(const iterator& rhs) const { return m_p != rhs.m_p; }
+
+        Message_prefix* const* m_p;
+    };
+
+    Message_batch(Message_prefix* const* messages, size_t num_messages):
+        m_messages(messages), m_num_messages(num_messages)
+    {}
+
+    size_t size() const { return m_num_messages; }
+    const MESSAGE_T& operator[](size_t i) const { return *(const MESSAGE_T*)m_messages[i]; }
+    iterator begin() const { return iterator{m_messages}; }
+    iterator end()   const { return iterator{m_messages + m_num_messages}; }
+
+private:
+    Message_prefix* const*  m_messages;
+    size_t                  m_num_messages;
+};
+
+
+
+// Returns the blob pool of the specified process, attaching to it if necessary.
+inline Blob_pool* get_blob_pool(instance_id_type process_iid);
+
+
+
 struct Message_ring_W: public Ring_W<char>
 {
     Message_ring_W(const string& directory, const string& prefix, uint64_t id) :
@@ -676,17 +1074,211 @@ struct Message_ring_W: public Ring_W<char>
         m_id(id)
     {}
 
+    ~Message_ring_W()
+    {
+        for (auto& r : m_blob_references) {
+            r.pool->release_chain(r.chain);
+        }
+
+        // the source rings release their own pins, when they are destroyed
+    }
+
     Message_ring_W(const Message_ring_W&) = delete;
     const Message_ring_W& operator = (const Message_ring_W&) = delete;
 
+
+    // Constructs a message in-place. Like in Ring_W, the caller must call done_writing().
+    // num_extra_elements is expected to be the return value of vb_size(), evaluated on the
+    // same arguments right before the call.
+    template <typename MESSAGE_T, typename... Args>
+    MESSAGE_T* write(size_t num_extra_elements, Args&&... args)
+    {
+        using S = variable_buffer::S;
+
+        // A message type with a stricter alignment than the prefix (see SINTRA_SIGNAL_ALIGNED)
+        // also aligns its payloads.
+        if (alignof(MESSAGE_T) > alignof(Message_prefix)) {
+            S::tl_payload_alignment = std::max(S::tl_payload_alignment, alignof(MESSAGE_T));
+        }
+
+        size_t alignment = 0;
+        if (S::tl_payload_alignment > 1) {
+            alignment = std::max(S::tl_payload_alignment, alignof(MESSAGE_T));
+
+            // the worst case, for the padding of each payload
+            num_extra_elements += S::tl_num_payloads * (S::tl_payload_alignment - 1);
+
+            // the padding is sized from the pending sequence, which may only be read by the
+            // thread that owns the ring, until the message is written
+            acquire_write_access();
+            write_padding(alignment);
+        }
+
+        auto msg = Ring_W::write<MESSAGE_T>(num_extra_elements, std::forward<Args>(args)...);
+
+        S::tl_payload_alignment = 1;
+        S::tl_num_payloads = 0;
+
+        if (alignment) {
+            msg->alignment = (uint32_t)alignment;
+            assert(msg->bytes_to_next_message <= sizeof(MESSAGE_T) + num_extra_elements);
+            discard_unused(sizeof(MESSAGE_T) + num_extra_elements - msg->bytes_to_next_message);
+        }
+
+        if (msg->blob_chain) {
+            // the reference was taken when the blobs were allocated
+            m_blob_references.push_back(
+                {get_pending_sequence(), get_blob_pool(m_id), msg->blob_chain});
+        }
+        release_overwritten_blobs();
+        return msg;
+    }
+
+
     void relay(const Message_prefix& msg)
     {
-        write((const char*)&msg, msg.bytes_to_next_message);
+        if (msg.alignment) {
+            acquire_write_access(); // see write()
+            write_padding(msg.alignment);
+        }
+        Ring_W::write((const char*)&msg, msg.bytes_to_next_message);
+        if (msg.blob_chain) {
+            // The blobs are still referenced by the ring the message is relayed from, because
+            // the reader is still accessing it.
+            auto pool = get_blob_pool(process_of(msg.sender_instance_id));
+            if (pool) {
+                pool->add_ref_chain(msg.blob_chain);
+                m_blob_references.push_back({get_pending_sequence(), pool, msg.blob_chain});
+            }
+        }
+        release_overwritten_blobs();
         done_writing();
     }
 
+
+    // Instead of copying a message that is being read from the request ring of another
+    // process, writes a descriptor, which the readers dereference into a read-only mapping of
+    // that ring. The octile of the message is pinned in the source ring, until all the
+    // readers of this ring are past the descriptor (see release_relay_pins()).
+    // Returns false if the message could not be pinned, in which case nothing is written.
+    bool relay_by_reference(const Message_prefix& msg, Message_ring_R& source)
+    {
+        int octile = source.pin((const char*)&msg);
+        if (octile < 0) {
+            return false;
+        }
+
+        auto d = Ring_W::write<Relay_descriptor>(0);
+        d->bytes_to_next_message    = sizeof(Relay_descriptor);
+        d->message_type_id          = (type_id_type)detail::reserved_id::relayed_by_reference;
+        d->function_instance_id     = msg.function_instance_id;
+        d->sender_instance_id       = msg.sender_instance_id;
+        d->receiver_instance_id     = msg.receiver_instance_id;
+        d->source_process_iid       = source.m_id;
+        d->offset                   = uint64_t((const char*)&msg - source.get_base_address());
+
+        {
+            spinlock::locker l(m_relay_pins_lock);
+            m_relay_pins.push_back({get_pending_sequence(), &source, octile});
+        }
+        release_overwritten_blobs();
+        done_writing();
+        return true;
+    }
+
+
+    // Unpins the relayed messages whose descriptors have been read by all the readers.
+    // This may be called from any thread. Returns the number of messages still pinned.
+    size_t release_relay_pins()
+    {
+        spinlock::locker l(m_relay_pins_lock);
+        if (m_relay_pins.empty()) {
+            return 0;
+        }
+
+        auto min_trailing = get_min_trailing_sequence();
+        while (!m_relay_pins.empty() && m_relay_pins.front().sequence <= min_trailing) {
+            auto& p = m_relay_pins.front();
+            p.source->unpin(p.octile);
+            m_relay_pins.pop_front();
+        }
+        return m_relay_pins.size();
+    }
+
+
+    // Unpins all the relayed messages, e.g. when the ring will no longer be read.
+    void drop_relay_pins()
+    {
+        spinlock::locker l(m_relay_pins_lock);
+        for (auto& p : m_relay_pins) {
+            p.source->unpin(p.octile);
+        }
+        m_relay_pins.clear();
+    }
+
 public:
     const uint64_t m_id;
+
+private:
+
+    // Writes a padding message, so that the next message starts at an address aligned to
+    // the specified alignment. The ring is mapped at a page boundary and its size is a
+    // multiple of any sensible alignment, thus sequences and addresses align alike.
+    // The caller must have acquired write access.
+    void write_padding(size_t alignment)
+    {
+        size_t misalignment = get_pending_sequence() % alignment;
+        if (!misalignment) {
+            return;
+        }
+
+        size_t num_bytes = alignment - misalignment;
+        while (num_bytes < sizeof(Message_prefix)) {
+            num_bytes += alignment;
+        }
+
+        auto padding = Ring_W::write<Message_prefix>(num_bytes - sizeof(Message_prefix));
+        padding->bytes_to_next_message = (uint32_t)num_bytes;
+        padding->message_type_id = (type_id_type)detail::reserved_id::message_padding;
+    }
+
+
+    // Releases the references of the messages whose descriptors have been overwritten.
+    // Once the writer has overwritten a region, no reader may access it, thus the blobs
+    // referenced in that region are no longer reachable through this ring.
+    void release_overwritten_blobs()
+    {
+        auto sequence = get_pending_sequence();
+        while (!m_blob_references.empty() &&
+            m_blob_references.front().sequence + m_num_elements <= sequence)
+        {
+            auto& r = m_blob_references.front();
+            r.pool->release_chain(r.chain);
+            m_blob_references.pop_front();
+        }
+    }
+
+
+    struct Blob_reference
+    {
+        sequence_counter_type   sequence;   // the end of the message in the ring
+        Blob_pool*              pool;
+        uint64_t                chain;
+    };
+
+    // Only accessed by the thread that holds the ring for writing
+    deque<Blob_reference>       m_blob_references;
+
+
+    struct Relay_pin
+    {
+        sequence_counter_type   sequence;   // the end of the descriptor in the ring
+        Message_ring_R*         source;
+        int                     octile;
+    };
+
+    spinlock                    m_relay_pins_lock;
+    deque<Relay_pin>            m_relay_pins;
 };
 
 
@@ -37,12 +37,161 @@ template <typename TC, typename T>
 variable_buffer::variable_buffer(const TC& container)
 {
     num_bytes = container.size() * sizeof(T);
+    copy(container.begin(), container.end(), (T*)allocate_payload());
+}
+
+
+inline
+char* variable_buffer::allocate_payload()
+{
+    // If vb_size() reserved a blob for this payload, it is not expected in the ring.
+    if (S::tl_next_reserved_blob < S::tl_num_reserved_blobs &&
+        S::tl_reserved_blobs[S::tl_next_reserved_blob].num_bytes == num_bytes)
+    {
+        blob_owner  = s_mproc_id;
+        blob_offset = S::tl_reserved_blobs[S::tl_next_reserved_blob++].offset;
+
+        auto pool = s_mproc->m_blob_pool;
+        auto& prefix = *(Message_prefix*)S::tl_message_start_address;
+        pool->header(blob_offset).next = prefix.blob_chain;
+        prefix.blob_chain = blob_offset;
+        return pool->data(blob_offset);
+    }
+
+    // the message start is aligned at least as strictly as the payload (see Message_ring_W)
+    auto alignment = S::tl_payload_alignment;
+    *S::tl_pbytes_to_next_message =
+        uint32_t((*S::tl_pbytes_to_next_message + alignment - 1) & ~(alignment - 1));
+
     char* data = S::tl_message_start_address + *S::tl_pbytes_to_next_message;
-    copy(container.begin(), container.end(), (T*)data);
 
     offset_in_bytes =
         *S::tl_pbytes_to_next_message - ((char*)this - S::tl_message_start_address);
     *S::tl_pbytes_to_next_message += (uint32_t)num_bytes;
+    return data;
+}
+
+
+inline
+message_gather::message_gather(const gather_list& list)
+{
+    num_bytes = list.payload_size();
+
+    // the table may be misaligned (see message_gather)
+    char* table = allocate_payload();
+    uint64_t entry = list.segments.size();
+    memcpy(table, &entry, sizeof(entry));
+
+    char* data = table + sizeof(uint64_t) * (1 + list.segments.size());
+    for (size_t i = 0; i < list.segments.size(); i++) {
+        auto& s = list.segments[i];
+        entry = s.end - s.begin;
+        memcpy(table + sizeof(uint64_t) * (1 + i), &entry, sizeof(entry));
+        data = copy(s.begin, s.end, data);
+    }
+}
+
+
+inline
+const char* variable_buffer::data() const
+{
+    if (blob_offset) {
+        auto pool = get_blob_pool(blob_owner);
+        assert(pool);
+        return pool->data(blob_offset);
+    }
+    return (const char*)this + offset_in_bytes;
+}
+
+
+inline
+bool variable_buffer::reserve_blob(size_t num_bytes)
+{
+    if (num_bytes < blob_spill_threshold ||
+        S::tl_num_reserved_blobs == max_reserved_blobs ||
+        !s_mproc || !s_mproc->m_blob_pool)
+    {
+        return false;
+    }
+
+    auto offset = s_mproc->m_blob_pool->allocate(num_bytes);
+    if (!offset) {
+        // the pool is exhausted, the payload will have to fit in the ring
+        return false;
+    }
+
+    S::tl_reserved_blobs[S::tl_num_reserved_blobs++] = {num_bytes, offset};
+    return true;
+}
+
+
+inline
+void variable_buffer::release_unused_blobs()
+{
+    while (S::tl_next_reserved_blob < S::tl_num_reserved_blobs) {
+        s_mproc->m_blob_pool->release(S::tl_reserved_blobs[S::tl_next_reserved_blob++].offset);
+    }
+    S::tl_num_reserved_blobs = S::tl_next_reserved_blob = 0;
+}
+
+
+inline
+Blob_pool* get_blob_pool(instance_id_type process_iid)
+{
+    if (process_iid == s_mproc_id) {
+        return s_mproc->m_blob_pool;
+    }
+
+    auto p = get_process_index(process_iid);
+    assert(p <= max_process_index);
+    auto& entry = s_mproc->m_blob_pools[p];
+    if (auto pool = entry.load(std::memory_order_acquire)) {
+        return pool;
+    }
+
+    lock_guard<mutex> lock(s_mproc->m_blob_pools_mutex);
+    auto pool = entry.load();
+    if (!pool) {
+        try {
+            pool = new Blob_pool(s_mproc->m_directory, process_iid, false);
+        }
+        catch (blob_pool_acquisition_failure_exception&) {
+            return nullptr;
+        }
+        entry.store(pool, std::memory_order_release);
+    }
+    return pool;
+}
+
+
+inline
+const char* get_relay_source(instance_id_type process_iid)
+{
+    auto p = get_process_index(process_iid);
+    assert(p <= max_process_index);
+    auto& entry = s_mproc->m_relay_sources[p];
+    if (auto ring = entry.load(std::memory_order_acquire)) {
+        return ring->get_base_address();
+    }
+
+    lock_guard<mutex> lock(s_mproc->m_relay_sources_mutex);
+    auto ring = entry.load();
+    if (!ring) {
+        // the ring would otherwise be created, if its process is gone
+        auto filename = get_base_filename("req", process_iid);
+        if (!fs::exists(s_mproc->m_directory + "/" + filename)) {
+            return nullptr;
+        }
+
+        try {
+            ring = new Ring_data<char, true>(s_mproc->m_directory, filename, message_ring_size);
+        }
+        catch (ring_acquisition_failure_exception&) {
+            return nullptr;
+        }
+        entry.store(ring, std::memory_order_release);
+    }
+    return ring->get_base_address();
 }
 
 
@@ -28,9 +28,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 
 #include "globals.h"
+#include "handler_dispatch.h"
 #include "message.h"
 
-#include <set>
+#include <cstring>
+#include <memory>
 
 
 namespace sintra {
@@ -42,6 +44,8 @@ using std::string;
 using std::thread;
 using std::mutex;
 using std::condition_variable;
+using std::shared_ptr;
+using std::vector;
 
 // Note: this should be a specialization of Message_reader (which does not exist), but for the sake
 // of simplicity and code coverage, the Message_reader was not implemented.
@@ -61,15 +65,68 @@ using std::condition_variable;
 
 
 static inline thread_local Message_prefix* s_tl_current_message = nullptr;
-static inline thread_local instance_id_type s_tl_common_function_iid = invalid_instance_id;
+static inline thread_local Message_ring_R* s_tl_current_ring = nullptr;
 
-static inline thread_local instance_id_type s_tl_additional_piids[max_process_index];
-static inline thread_local size_t s_tl_additional_piids_size = 0;
+// Retains the message being handled, in its ring, beyond the return of its handler.
+// This may only be called from within the handler of an event. If the message cannot be
+// retained, the returned handle is empty.
+template <typename MESSAGE_T>
+Retained_message<MESSAGE_T> retain(const MESSAGE_T& message)
+{
+    auto prefix = static_cast<const Message_prefix*>(&message);
+    if (!s_tl_current_ring || prefix != s_tl_current_message) {
+        return Retained_message<MESSAGE_T>();
+    }
+
+    int octile = s_tl_current_ring->pin((const char*)prefix);
+    if (octile < 0) {
+        return Retained_message<MESSAGE_T>();
+    }
+    return Retained_message<MESSAGE_T>(&message, s_tl_current_ring, octile);
+}
+
+
+// Like retain(), but if the message cannot be retained, it is copied, along with a reference
+// to its blobs, if any. Thus the returned pointer is never null, and it may be shared among
+// threads. This is what handlers running on an executor are given.
+template <typename MESSAGE_T>
+shared_ptr<const MESSAGE_T> hold(const MESSAGE_T& message)
+{
+    auto prefix = static_cast<const Message_prefix*>(&message);
+    if (s_tl_current_ring && prefix == s_tl_current_message) {
+        auto ring = s_tl_current_ring;
+        int octile = ring->pin((const char*)prefix);
+        if (octile >= 0) {
+            return shared_ptr<const MESSAGE_T>(&message, [ring, octile](const MESSAGE_T*) {
+                ring->unpin(octile);
+            });
+        }
+    }
+
+    // The payload of a variable buffer is addressed relative to the buffer, and it may be
+    // aligned (see vb_alignment), thus the copy must keep the alignment of the original.
+    size_t size = prefix->bytes_to_next_message;
+    size_t phase = uintptr_t(prefix) % max_vb_alignment;
+    char* storage = new char[size + max_vb_alignment];
+    char* copy = storage +
+        (phase + max_vb_alignment - uintptr_t(storage) % max_vb_alignment) % max_vb_alignment;
+    memcpy(copy, prefix, size);
+
+    Blob_pool* pool = nullptr;
+    if (prefix->blob_chain) {
+        pool = get_blob_pool(process_of(prefix->sender_instance_id));
+        if (pool) {
+            pool->add_ref_chain(prefix->blob_chain);
+        }
+    }
 
-// This exists because it may occur that there are multiple outstanding RPC calls
-// from different threads.
-static inline mutex s_outstanding_rpcs_mutex;
-static inline std::set<Outstanding_rpc_control*> s_outstanding_rpcs;
+    return shared_ptr<const MESSAGE_T>((const MESSAGE_T*)copy, [storage, pool](const MESSAGE_T* m) {
+        if (pool) {
+            pool->release_chain(m->blob_chain);
+        }
+        delete [] storage;
+    });
+}
 
 
 struct Process_message_reader
@@ -81,8 +138,11 @@ struct Process_message_reader
         STOPPING
     };
 
+    // If lane is true, the reader reads the lanes of the specified process, i.e. the rings
+    // through which the coordinator relays the requests and replies addressed to it, instead
+    // of the rings of the process. See Managed_process::relay_ring()
     inline
-    Process_message_reader(instance_id_type process_instance_id);
+    Process_message_reader(instance_id_type process_instance_id, bool lane = false);
 
     inline
     ~Process_message_reader();
@@ -132,13 +192,30 @@ struct Process_message_reader
         return m_in_req_c->get_message_reading_sequence();
     }
 
+    sequence_counter_type get_request_leading_sequence() const
+    {
+        return m_in_req_c->get_leading_sequence();
+    }
+
+
+    // Blocks until the request reader has read the ring up to the specified sequence, or
+    // until the reader is stopped.
+    inline
+    void flush(sequence_counter_type flush_sequence);
+
     State state() const {return m_state;}
 
 private:
 
+    // Dispatches the run of event messages in m_batch, where the record of their type holds
+    // batch handlers.
+    inline
+    void dispatch_batch(const Dispatch_snapshot::type_record_type& record);
+
     atomic<State>           m_state                 = NORMAL_MODE;
 
     instance_id_type        m_process_instance_id;
+    bool                    m_lane                  = false;
 
     Message_ring_R*         m_in_req_c              = nullptr;
     Message_ring_R*         m_in_rep_c              = nullptr;
@@ -150,6 +227,14 @@ private:
     atomic<bool>            m_rep_running           = false;
     mutex                   m_stop_mutex;
     condition_variable      m_stop_condition;
+
+    atomic<int>             m_num_flush_waiters     = 0;
+    mutex                   m_flush_mutex;
+    condition_variable      m_flush_condition;
+
+    // used by the request reader, when dispatching batches
+    vector<Message_prefix*> m_batch;
+    vector<Message_prefix*> m_batch_of_sender;
 };
 
 
@@ -41,12 +41,19 @@ inline function<void()> thread_local tl_post_handler_function = nullptr;
 
 
 inline
-Process_message_reader::Process_message_reader(instance_id_type process_instance_id):
+Process_message_reader::Process_message_reader(instance_id_type process_instance_id, bool lane):
     m_state(NORMAL_MODE),
-    m_process_instance_id(process_instance_id)
+    m_process_instance_id(process_instance_id),
+    m_lane(lane)
 {
-    m_in_req_c = new Message_ring_R(s_mproc->m_directory, "req", m_process_instance_id);
-    m_in_rep_c = new Message_ring_R(s_mproc->m_directory, "rep", m_process_instance_id);
+    m_in_req_c = new Message_ring_R(s_mproc->m_directory, lane ? "lreq" : "req", m_process_instance_id);
+    m_in_rep_c = new Message_ring_R(s_mproc->m_directory, lane ? "lrep" : "rep", m_process_instance_id);
+
+    // The pool of the process is attached here, rather than by the first payload that needs it.
+    // Pools of other processes, whose messages are relayed, are attached on first use.
+    if (!lane && m_process_instance_id != s_mproc_id) {
+        get_blob_pool(m_process_instance_id);
+    }
     m_request_reader_thread = new thread([&] () { request_reader_function(); });
     m_request_reader_thread->detach();
     m_reply_reader_thread   = new thread([&] () { reply_reader_function();   });
@@ -74,8 +81,8 @@ void Process_message_reader::stop_nowait()
 {    
     m_state = STOPPING;
 
-    m_in_req_c->done_reading();
-    m_in_req_c->unblock_local();
+    // The reader threads release their rings themselves, once they see the request.
+    m_in_req_c->request_stop();
 
 
 
@@ -95,8 +102,7 @@ void Process_message_reader::stop_nowait()
     // reading thread to exit will happen only after the request reading loop
     // exits.
     auto force_exit_reply_ring = [this]() {
-        m_in_rep_c->done_reading();
-        m_in_rep_c->unblock_local();
+        m_in_rep_c->request_stop();
     };
 
     if (!tl_is_req_thread) {
@@ -108,6 +114,21 @@ void Process_message_reader::stop_nowait()
 }
 
 
+inline
+void Process_message_reader::flush(sequence_counter_type flush_sequence)
+{
+    std::unique_lock<std::mutex> lk(m_flush_mutex);
+    m_num_flush_waiters++;
+    while (get_request_reading_sequence() < flush_sequence && m_state != STOPPING) {
+        // The reader might have checked for waiters right before this one was counted,
+        // in which case it will not notify until it reads another message, thus the
+        // wait is bounded.
+        m_flush_condition.wait_for(lk, std::chrono::milliseconds(10));
+    }
+    m_num_flush_waiters--;
+}
+
+
 inline
 bool Process_message_reader::stop_and_wait(double waiting_period)
 {
@@ -164,6 +185,7 @@ void Process_message_reader::request_reader_function()
     install_signal_handler();
 
     tl_is_req_thread = true;
+    s_mproc->m_handler_dispatch.register_reader();
 
     s_mproc->m_num_active_readers_mutex.lock();
     s_mproc->m_num_active_readers++;
@@ -172,21 +194,16 @@ void Process_message_reader::request_reader_function()
     m_in_req_c->start_reading();
     m_req_running = true;
 
+    s_tl_current_ring = m_in_req_c;
+
     while (m_state != STOPPING) {
         s_tl_current_message = nullptr;
 
-        // if there is an interprocess barrier and m_in_req_c has reached the barrier's sequence,
-        // then the barrier is good to go.
-        if (!s_mproc->m_flush_sequence.empty()) {
-            auto reading_sequence = m_in_req_c->get_message_reading_sequence();
-            while (reading_sequence >= s_mproc->m_flush_sequence.front()) {
-                lock_guard<mutex> lk(s_mproc->m_flush_sequence_mutex);
-                s_mproc->m_flush_sequence.pop_front();
-                s_mproc->m_flush_sequence_condition.notify_one();
-                if (s_mproc->m_flush_sequence.empty()) {
-                    break;
-                }
-            }
+        // if there is an interprocess barrier waiting for m_in_req_c to reach some sequence,
+        // it checks the reading sequence whenever it is notified. See flush()
+        if (m_num_flush_waiters) {
+            lock_guard<mutex> lk(m_flush_mutex);
+            m_flush_condition.notify_all();
         }
 
         Message_prefix* m = m_in_req_c->fetch_message();
@@ -196,11 +213,12 @@ void Process_message_reader::request_reader_function()
         }
 
         // Only the process with the coordinator's instance is allowed to send messages on
-        // someone else's behalf (for relay purposes).
+        // someone else's behalf (for relay purposes), which is all that the lanes carry.
         // TODO: If some process not being part of the core set of processes sends nonsense,
         // it might be a good idea to kill it. If it is in the core set of processes,
         // then it would be a bug.
-        assert(m_in_req_c->m_id == process_of(m->sender_instance_id) ||
+        assert(m_lane ||
+               m_in_req_c->m_id == process_of(m->sender_instance_id) ||
                m_in_req_c->m_id == process_of(s_coord_id));
 
         assert(m->message_type_id != not_defined_type_id);
@@ -235,48 +253,62 @@ void Process_message_reader::request_reader_function()
 
             // this is an interprocess event message.
 
-            if ((m_state == NORMAL_MODE) ||
-                (s_coord && m->message_type_id > (type_id_type)detail::reserved_id::base_of_messages_handled_by_coordinator))
+            // the messages handled in this iteration, which are more than one with batches
+            Message_prefix* const* run = &m;
+            size_t run_size = 1;
+
+            if (((m_state == NORMAL_MODE) ||
+                 (s_coord && m->message_type_id > (type_id_type)detail::reserved_id::base_of_messages_handled_by_coordinator)) &&
+                !is_local_echo(*m))
             {
-                lock_guard<recursive_mutex> sl(s_mproc->m_handlers_mutex);
-                    
-                // [ NEW IMPLEMENTATION - NOT COVERED ]
+                Handler_dispatch::Read_guard snapshot(s_mproc->m_handler_dispatch);
+
                 // find handlers that operate with this type of message in this process
-                auto it_mt = s_mproc->m_active_handlers.find(m->message_type_id);
-                if (it_mt != s_mproc->m_active_handlers.end()) {
-
-                    instance_id_type sids[] = {
-                        m->sender_instance_id,
-                        any_remote,
-                        any_local_or_remote
-                    };
-
-                    for (auto sid : sids) {
-                        auto shl = it_mt->second.find(sid);
-                        if (shl != it_mt->second.end()) {
-                            for (auto& e : shl->second) {
-                                e(*m);
-                            }
+                // (batch handlers, if any, are at the end of the record)
+                auto record = snapshot->find(m->message_type_id);
+                if (record && record->back().batch_handler) {
+                    m_batch.assign(1, m);
+                    m_in_req_c->fetch_run(m_batch);
+                    dispatch_batch(*record);
+                    run = m_batch.data();
+                    run_size = m_batch.size();
+                }
+                else
+                if (record) {
+                    for (auto& e : *record) {
+                        if (e.sender == m->sender_instance_id ||
+                            e.sender == any_remote ||
+                            e.sender == any_local_or_remote)
+                        {
+                            e.handler(*m);
                         }
                     }
                 }
             }
 
-            // if the coordinator is in this process, relay
-            if (s_coord && !has_same_mapping(*m_in_req_c, *s_mproc->m_out_req_c)) {
-                s_mproc->m_out_req_c->relay(*m);
+            // if the coordinator is in this process, relay, unless no other process has
+            // handlers for this type of message (see interest_map.h), or each process reads
+            // the rings of the others (mesh mode)
+            if (s_coord && !s_mesh && !has_same_mapping(*m_in_req_c, *s_mproc->m_out_req_c) &&
+                s_mproc->m_interest_map->is_of_interest(
+                    m->message_type_id, process_of(m->sender_instance_id)))
+            {
+                for (size_t i = 0; i < run_size; i++) {
+                    s_mproc->relay_request(s_mproc->m_out_req_c, *run[i], *m_in_req_c);
+                }
             }
         }
         else {
-            // a local event has no place in interprocess messages
-            // this would be a bug.
+            // local events are never written to the rings (see local_events.h)
             assert(m->receiver_instance_id != any_local);
 
             // a specific non-local receiver means an rpc to another process.
-            // if the coordinator is in this process, relay
-            if (s_coord && !has_same_mapping(*m_in_req_c, *s_mproc->m_out_req_c)) {
+            // if the coordinator is in this process, relay, through the lane of the receiver
+            // if it has one. In mesh mode, the receiver reads the request from its origin.
+            if (s_coord && !s_mesh && !has_same_mapping(*m_in_req_c, *s_mproc->m_out_req_c)) {
                 // the message type is specified, thus it is a request
-                s_mproc->m_out_req_c->relay(*m);
+                s_mproc->relay_request(
+                    s_mproc->relay_ring(m->receiver_instance_id, false), *m, *m_in_req_c);
             }
         }
 
@@ -286,6 +318,8 @@ void Process_message_reader::request_reader_function()
         }
     }
 
+    s_tl_current_ring = nullptr;
+    s_mproc->m_handler_dispatch.unregister_reader();
     m_in_req_c->done_reading();
 
     s_mproc->m_num_active_readers_mutex.lock();
@@ -300,6 +334,50 @@ void Process_message_reader::request_reader_function()
 
 
 
+inline
+void Process_message_reader::dispatch_batch(const Dispatch_snapshot::type_record_type& record)
+{
+    // the handlers of the individual messages come first, message by message
+    for (auto m : m_batch) {
+        s_tl_current_message = m;
+        for (auto& e : record) {
+            if (e.handler && (
+                e.sender == m->sender_instance_id ||
+                e.sender == any_remote ||
+                e.sender == any_local_or_remote))
+            {
+                e.handler(*m);
+            }
+        }
+    }
+
+    // The messages of a batch cannot be retained, but hold() will still copy them.
+    s_tl_current_message = nullptr;
+
+    for (auto& e : record) {
+        if (!e.batch_handler) {
+            continue;
+        }
+
+        if (e.sender == any_remote || e.sender == any_local_or_remote) {
+            e.batch_handler(m_batch.data(), m_batch.size());
+            continue;
+        }
+
+        m_batch_of_sender.clear();
+        for (auto m : m_batch) {
+            if (m->sender_instance_id == e.sender) {
+                m_batch_of_sender.push_back(m);
+            }
+        }
+        if (!m_batch_of_sender.empty()) {
+            e.batch_handler(m_batch_of_sender.data(), m_batch_of_sender.size());
+        }
+    }
+}
+
+
+
 inline
 void Process_message_reader::reply_reader_function()
 {
@@ -322,8 +400,9 @@ void Process_message_reader::reply_reader_function()
         }
 
         // Only the process with the coordinator's instance is allowed to send messages on
-        // someone else's behalf (for relay purposes).
-        assert(m_in_rep_c->m_id == process_of(m->sender_instance_id) ||
+        // someone else's behalf (for relay purposes), which is all that the lanes carry.
+        assert(m_lane ||
+               m_in_rep_c->m_id == process_of(m->sender_instance_id) ||
                m_in_rep_c->m_id == process_of(s_coord_id));
 
         assert(m->receiver_instance_id != any_local);
@@ -335,33 +414,32 @@ void Process_message_reader::reply_reader_function()
                 (m->sender_instance_id   == s_coord_id) )
             {
 
-                auto it = s_mproc->m_local_pointer_of_instance_id.find(m->receiver_instance_id);
-
-                if (it != s_mproc->m_local_pointer_of_instance_id.end()) {
-                    auto &return_handlers = it->second->m_active_return_handlers;
-
-                    it->second->m_return_handlers_mutex.lock();
-                    auto it2 = return_handlers.find(m->function_instance_id);
-                    it->second->m_return_handlers_mutex.unlock();
-
-                    if (it2 != return_handlers.end()) {
-                        if (m->exception_type_id == not_defined_type_id) {
-                            it2->second.return_handler(*m);
-                        }
-                        else
-                        if (m->exception_type_id != (type_id_type)detail::reserved_id::deferral) {
-                            it2->second.exception_handler(*m);
-                        }
-                        else {
-                            it2->second.deferral_handler(*m);
-                        }
-                    }
-                    else {
-                        // If it exists, there must be a return handler assigned.
-                        // This is most likely an error local to this process.
-                        assert(!"There is no active handler for the function return.");
+                // RPC calls are made on behalf of the managed process, thus most replies
+                // are addressed to it, and it does not need to be looked up.
+                Transceiver* receiver = nullptr;
+                if (m->receiver_instance_id == s_mproc_id) {
+                    receiver = s_mproc;
+                }
+                else {
+                    auto it = s_mproc->m_local_pointer_of_instance_id.find(m->receiver_instance_id);
+                    if (it != s_mproc->m_local_pointer_of_instance_id.end()) {
+                        receiver = it->second;
                     }
                 }
+
+                if (receiver) {
+                    // If there is no handler, the call is no longer waiting (e.g. it timed
+                    // out), thus the reply is dropped.
+                    receiver->m_return_handlers.invoke(m->function_instance_id,
+                        [m](const Return_handler& rh) {
+                            if (m->exception_type_id == not_defined_type_id) {
+                                rh.return_handler(rh.context, *m);
+                            }
+                            else {
+                                rh.exception_handler(rh.context, *m);
+                            }
+                        });
+                }
                 else {
                     // This can occur by both local and remote error.
                     assert(!"The object that this return message refers to does not exist.");
@@ -372,10 +450,11 @@ void Process_message_reader::reply_reader_function()
 
             // A specific non-local receiver implies an rpc call to another process,
             // thus if the coordinator is in the current process, relay -
-            // unless the message originates from the ring we would relay to.
-            if (s_coord && !has_same_mapping(*s_mproc->m_out_rep_c, *m_in_rep_c) ) {
+            // unless the message originates from the ring we would relay to, or
+            // the receiver reads it from its origin (mesh mode).
+            if (s_coord && !s_mesh && !has_same_mapping(*s_mproc->m_out_rep_c, *m_in_rep_c) ) {
                 // the message type is not specified, thus it is a reply
-                s_mproc->m_out_rep_c->relay(*m);
+                s_mproc->relay_ring(m->receiver_instance_id, true)->relay(*m);
             }
         }
     }
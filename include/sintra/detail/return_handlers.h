@@ -0,0 +1,279 @@
+/*
+Copyright 2017 Ioannis Makris
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef SINTRA_RETURN_HANDLERS_H
+#define SINTRA_RETURN_HANDLERS_H
+
+
+#include "config.h"
+#include "id_types.h"
+#include "message.h"
+
+#include <atomic>
+#include <cassert>
+#include <stdexcept>
+#include <thread>
+
+
+namespace sintra {
+
+
+using std::atomic;
+
+
+/*
+
+The return handlers of the outstanding RPC calls of a transceiver are kept in a table of slots,
+which is looked up and modified without locking, and only allocates when a block is first used.
+
+1. The function instance id of a call encodes the position of its slot, and a generation,
+   which is incremented whenever the slot is reused. The table is made of blocks, which are
+   allocated as needed and never released before the table, thus slots do not move.
+
+2. A slot holds its function instance id while it is active. A reader invoking a handler
+   increments the busy counter of the slot, then checks that the id still matches. Deactivation
+   replaces the id, then waits until the slot is no longer busy, thus once it returns, the
+   handlers of the call have returned as well, and whatever they refer to may be released.
+
+3. A handler may deactivate its own slot (e.g. the handler of an asynchronous call), in which
+   case its own invocation is no longer counted, and the deactivation only waits for others.
+
+*/
+
+
+struct Return_handler
+{
+    using handler_type = void (*)(void* context, const Message_prefix& msg);
+
+    handler_type                        return_handler      = nullptr;
+    handler_type                        exception_handler   = nullptr;
+
+    // Called by unblock_rpc(), if the process of the remote instance is gone.
+    void                              (*abort_handler)(void* context) = nullptr;
+
+    void*                               context             = nullptr;
+    instance_id_type                    instance_id         = 0;    // the remote instance
+};
+
+
+
+class Return_handler_table
+{
+public:
+
+    static constexpr size_t             num_slots_per_block = 0x100;
+    static constexpr size_t             max_blocks          = 0x40;
+    static constexpr int                position_bits       = 14;
+    static_assert(num_slots_per_block * max_blocks == size_t(1) << position_bits);
+
+    // Set in the ids of the slots, but never in those made by make_instance_id(), which only
+    // reach this after an unrealistic number of instances.
+    static constexpr instance_id_type   slot_flag           =
+        instance_id_type(1) << (num_transceiver_index_bits - 2);
+    static constexpr uint64_t           generation_mask     =
+        (uint64_t(1) << (num_transceiver_index_bits - 2 - position_bits)) - 1;
+
+
+    Return_handler_table() {}
+
+    ~Return_handler_table()
+    {
+        for (auto& b : m_blocks) {
+            delete b.load();
+        }
+    }
+
+    Return_handler_table(const Return_handler_table&) = delete;
+    const Return_handler_table& operator = (const Return_handler_table&) = delete;
+
+
+    // Returns the function instance id of the call, which identifies its slot.
+    instance_id_type activate(const Return_handler& rh)
+    {
+        size_t start = m_hint.fetch_add(1, std::memory_order_relaxed);
+
+        for (size_t b = 0; b < max_blocks; b++) {
+            auto block = get_block(b);
+            for (size_t i = 0; i < num_slots_per_block; i++) {
+                size_t index = (start + i) % num_slots_per_block;
+                auto& slot = block->slots[index];
+
+                instance_id_type expected = free_slot;
+                if (slot.fiid.load(std::memory_order_relaxed) != free_slot ||
+                    !slot.fiid.compare_exchange_strong(expected, claimed_slot))
+                {
+                    continue;
+                }
+
+                slot.handler = rh;
+                slot.generation = (slot.generation + 1) & generation_mask;
+
+                instance_id_type fiid = (s_mproc_id & pid_mask) | slot_flag |
+                    (slot.generation << position_bits) | (b * num_slots_per_block + index);
+                slot.fiid.store(fiid);
+                return fiid;
+            }
+        }
+        throw std::runtime_error("There are too many outstanding RPC calls.");
+    }
+
+
+    // Once this returns, no handler of the call is running, unless it is called from one.
+    // The id must be the one returned by activate().
+    void deactivate(instance_id_type fiid)
+    {
+        auto slot = find_slot(fiid);
+        assert(slot);
+
+        instance_id_type expected = fiid;
+        if (!slot->fiid.compare_exchange_strong(expected, claimed_slot)) {
+            return;
+        }
+
+        if (s_tl_invoked_slot == slot) {
+            s_tl_invoked_slot = nullptr;
+            slot->busy--;
+        }
+        while (slot->busy.load()) {
+            std::this_thread::yield();
+        }
+
+        slot->fiid.store(free_slot);
+    }
+
+
+    // Calls f with the handler of the call, if it is active. Returns false otherwise.
+    template <typename F>
+    bool invoke(instance_id_type fiid, const F& f)
+    {
+        if (!(fiid & slot_flag)) {
+            return false;
+        }
+
+        auto slot = find_slot(fiid);
+        return slot && invoke(*slot, fiid, f);
+    }
+
+
+    // Calls f with the handler of each active call.
+    template <typename F>
+    void for_each(const F& f)
+    {
+        for (auto& b : m_blocks) {
+            auto block = b.load();
+            if (!block) {
+                break;
+            }
+            for (auto& slot : block->slots) {
+                auto fiid = slot.fiid.load();
+                if (fiid & slot_flag) {
+                    invoke(slot, fiid, f);
+                }
+            }
+        }
+    }
+
+
+private:
+
+    static constexpr instance_id_type   free_slot           = 0;
+    static constexpr instance_id_type   claimed_slot        = 1;
+
+
+    struct alignas(assumed_cache_line_size) Slot
+    {
+        atomic<instance_id_type>        fiid                = free_slot;
+        atomic<int>                     busy                = 0;
+        uint64_t                        generation          = 0;
+        Return_handler                  handler;
+    };
+
+
+    struct Block
+    {
+        Slot                            slots[num_slots_per_block];
+    };
+
+
+    Block* get_block(size_t b)
+    {
+        auto block = m_blocks[b].load();
+        if (!block) {
+            auto new_block = new Block;
+            if (m_blocks[b].compare_exchange_strong(block, new_block)) {
+                block = new_block;
+            }
+            else {
+                delete new_block;
+            }
+        }
+        return block;
+    }
+
+
+    Slot* find_slot(instance_id_type fiid) const
+    {
+        size_t position = size_t(fiid & ((uint64_t(1) << position_bits) - 1));
+        auto block = m_blocks[position / num_slots_per_block].load();
+        return block ? &block->slots[position % num_slots_per_block] : nullptr;
+    }
+
+
+    template <typename F>
+    bool invoke(Slot& slot, instance_id_type fiid, const F& f)
+    {
+        slot.busy++;
+        if (slot.fiid.load() != fiid) {
+            slot.busy--;
+            return false;
+        }
+
+        // the handler cannot change while the slot is busy
+        auto handler = slot.handler;
+
+        auto previous = s_tl_invoked_slot;
+        s_tl_invoked_slot = &slot;
+        f(handler);
+        if (s_tl_invoked_slot == &slot) {
+            slot.busy--;
+        }
+        s_tl_invoked_slot = previous;
+        return true;
+    }
+
+
+    atomic<Block*>                      m_blocks[max_blocks]    = {};
+    atomic<size_t>                      m_hint                  = 0;
+
+    // the slot whose handler is being invoked by the calling thread, if it still counts as busy
+    inline static thread_local Slot*    s_tl_invoked_slot       = nullptr;
+};
+
+
+} // namespace sintra
+
+
+#endif
@@ -0,0 +1,251 @@
+/*
+Copyright 2017 Ioannis Makris
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SINTRA_RPC_STREAM_H
+#define SINTRA_RPC_STREAM_H
+
+
+#include "config.h"
+#include "id_types.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+namespace sintra {
+
+
+using std::condition_variable;
+using std::deque;
+using std::function;
+using std::mutex;
+using std::shared_ptr;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+
+/*
+
+An exported function may return a stream<T>, in which case its result is delivered to the
+caller as a sequence of T, each in a reply of its own, rather than as a single value, which
+would have to fit in a single message, and would only reach the caller once complete.
+
+1. A stream is made of a function returning the next item, or nothing at the end, or of a
+   vector of items. It is only pulled once the function has returned, by the thread handling
+   the call (i.e. the request reader, or the executor of the callee, see set_rpc_executor()),
+   thus items that take time to produce should be produced on an executor.
+
+2. The callee writes at most rpc_stream_window items ahead of the caller. The caller grants
+   more as it consumes them, with rpc_stream_credit messages, thus neither the rings nor the
+   caller's queue are flooded by a large result.
+
+3. The caller receives an Rpc_stream<T>, which is read with next(), or iterated as a range.
+   The stream ends with an rpc_stream_end reply, or with an exception, which is thrown by
+   next() once the preceding items have been read. Each item is waited for as long as a
+   synchronous call would wait for its reply (see Rpc_timeout).
+
+4. A stream that is destroyed before its end, or times out, is cancelled, and the callee
+   stops pulling it. A stream is also abandoned if either its caller or its callee is gone,
+   which the other side is notified of.
+
+*/
+
+
+template <typename T>
+class stream
+{
+    static_assert(!std::is_void_v<T> && !std::is_reference_v<T>,
+        "A stream must be of values.");
+
+public:
+
+    using value_type = T;
+
+    // An empty stream.
+    stream():
+        m_next([]() { return std::optional<T>(); })
+    {}
+
+    stream(function<std::optional<T>()> next):
+        m_next(std::move(next))
+    {}
+
+    stream(vector<T> values)
+    {
+        auto v = std::make_shared<vector<T>>(std::move(values));
+        m_next = [v, i = size_t(0)]() mutable {
+            return i < v->size() ? std::optional<T>(std::move((*v)[i++])) : std::optional<T>();
+        };
+    }
+
+
+    std::optional<T> next() { return m_next(); }
+
+
+private:
+
+    function<std::optional<T>()>        m_next;
+};
+
+
+template <typename R>
+struct is_stream: std::false_type {};
+
+template <typename T>
+struct is_stream<stream<T>>: std::true_type {};
+
+
+
+// The state of a stream being written by a callee. It is kept by the process of the callee,
+// keyed by the caller and the function instance id of the call, until the stream ends.
+struct Outgoing_rpc_stream
+{
+    mutex                               m;
+    instance_id_type                    caller_iid          = invalid_instance_id;
+    instance_id_type                    function_iid        = invalid_instance_id;
+    instance_id_type                    callee_iid          = invalid_instance_id;
+    uint32_t                            credit              = rpc_stream_window;
+    bool                                finished            = false;
+
+    // Writes the next item, or the end of the stream. Returns false once it has written the
+    // end (or an exception), after which it is not called again.
+    function<bool()>                    write_next;
+
+    // Writes an exception to the caller, when the stream is abandoned by the callee.
+    function<void(const string&)>       write_failure;
+};
+
+
+
+// The stream received by the caller of a function returning stream<T>.
+template <typename T>
+class Rpc_stream
+{
+public:
+
+    using value_type = T;
+
+    Rpc_stream(Rpc_stream&&) = default;
+    Rpc_stream& operator=(Rpc_stream&& other)
+    {
+        if (this != &other) {
+            close();
+            m_state = std::move(other.m_state);
+        }
+        return *this;
+    }
+
+    ~Rpc_stream() { close(); }
+
+
+    // Waits for the next item. Returns false at the end of the stream, or throws the exception
+    // of the callee, or rpc_timeout_exception.
+    bool next(T& value);
+
+
+    class iterator
+    {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type        = T;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const T*;
+        using reference         = const T&;
+
+        iterator() {}
+        explicit iterator(Rpc_stream* s): m_stream(s) { ++(*this); }
+
+        reference operator*() const  { return *m_value; }
+        pointer   operator->() const { return &*m_value; }
+
+        iterator& operator++()
+        {
+            T v;
+            if (m_stream->next(v)) {
+                m_value.emplace(std::move(v));
+            }
+            else {
+                m_stream = nullptr;
+                m_value.reset();
+            }
+            return *this;
+        }
+
+        bool operator==(const iterator& rhs) const { return m_stream == rhs.m_stream; }
+        bool operator!=(const iterator& rhs) const { return m_stream != rhs.m_stream; }
+
+    private:
+        Rpc_stream*                     m_stream            = nullptr;
+        std::optional<T>                m_value;
+    };
+
+    iterator begin() { return iterator(this); }
+    iterator end()   { return iterator(); }
+
+
+private:
+
+    struct State
+    {
+        mutex                           m;
+        condition_variable              cv;
+        deque<T>                        items;
+        bool                            ended               = false;
+        bool                            aborted             = false;
+        type_id_type                    ex_tid              = not_defined_type_id;
+        string                          ex_what;
+
+        instance_id_type                callee_iid          = invalid_instance_id;
+        instance_id_type                function_iid        = invalid_instance_id;
+        uint32_t                        consumed            = 0;
+        bool                            released            = false;
+    };
+
+    Rpc_stream(): m_state(new State) {}
+
+    // Deactivates the return handler of the stream, cancelling it if it has not ended.
+    void close();
+
+    unique_ptr<State>                   m_state;
+
+    friend struct Transceiver;
+};
+
+
+} // namespace sintra
+
+
+#endif
@@ -0,0 +1,228 @@
+/*
+Copyright 2017 Ioannis Makris
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SINTRA_SHARED_ARENA_H
+#define SINTRA_SHARED_ARENA_H
+
+
+#include "config.h"
+
+#include <cassert>
+#include <cstdint>
+#include <memory_resource>
+#include <stdexcept>
+#include <string>
+
+#include <boost/interprocess/allocators/allocator.hpp>
+#include <boost/interprocess/containers/string.hpp>
+#include <boost/interprocess/containers/vector.hpp>
+#include <boost/interprocess/managed_mapped_file.hpp>
+
+
+namespace sintra {
+
+
+using std::string;
+namespace ipc = boost::interprocess;
+
+
+/*
+
+The shared arena is a swarm-wide heap in shared memory, which allows handing large object
+graphs over to other processes without serializing them. A producer builds its objects in the
+arena and sends a handle, which is an offset into the arena, and can thus be sent as any other
+message argument.
+
+There are two ways to build containers in the arena:
+
+1. With the memory resource returned by resource(), using the std::pmr containers.
+   The pointers held by std::pmr containers are raw pointers. In order for these to be valid
+   in all processes, every process tries to map the arena at shared_arena_address, and
+   resource() is only available if that succeeded. Note that a polymorphic allocator refers
+   to the memory resource of the process that created the container, thus a receiving process
+   may read and modify the elements in place, but it must neither resize nor destroy the
+   container.
+
+2. With arena_allocator and the containers based on it (arena_vector, arena_string), which
+   use offset pointers. These are valid at any mapping address, and can be resized or
+   destroyed by any process.
+
+*/
+
+
+template <typename T>
+struct Arena_handle
+{
+    // The offset of the object from the base of the arena, or 0 for a null handle.
+    // This is deliberately left without an initializer, to keep the type trivial and thus
+    // sendable as is.
+    uint64_t offset;
+
+    explicit operator bool() const { return offset != 0; }
+
+    // Returns the address of the object in the calling process.
+    template <typename = void>
+    T* get() const;
+};
+
+
+
+struct Shared_arena
+{
+    using segment_type          = ipc::managed_mapped_file;
+    using segment_manager_type  = segment_type::segment_manager;
+
+
+    Shared_arena(const string& directory)
+    {
+        auto filename = directory + "/arena";
+        try {
+            m_segment = new segment_type(ipc::open_or_create, filename.c_str(),
+                shared_arena_size, (void*)shared_arena_address);
+            m_at_common_address = shared_arena_address != 0;
+        }
+        catch (ipc::interprocess_exception&) {
+            // The address range is taken in this process. Offset pointers and handles will
+            // still work, but the raw pointers of pmr containers would not.
+            m_segment = new segment_type(ipc::open_or_create, filename.c_str(), shared_arena_size);
+            m_at_common_address = false;
+        }
+
+        m_resource.m_segment_manager = m_segment->get_segment_manager();
+    }
+
+
+    ~Shared_arena()
+    {
+        delete m_segment;
+    }
+
+
+    Shared_arena(const Shared_arena&) = delete;
+    const Shared_arena& operator = (const Shared_arena&) = delete;
+
+
+    // True if the arena is mapped at the same address in this process as in any other
+    // process that managed to map it at the common address.
+    bool at_common_address() const { return m_at_common_address; }
+
+
+    std::pmr::memory_resource* resource()
+    {
+        if (!m_at_common_address) {
+            throw std::runtime_error(
+                "The shared arena could not be mapped at the common address in this process.");
+        }
+        return &m_resource;
+    }
+
+
+    template <typename T>
+    ipc::allocator<T, segment_manager_type> allocator()
+    {
+        return ipc::allocator<T, segment_manager_type>(m_segment->get_segment_manager());
+    }
+
+
+    template <typename T, typename... Args>
+    T* construct(Args&&... args)
+    {
+        return m_segment->construct<T>(ipc::anonymous_instance)(std::forward<Args>(args)...);
+    }
+
+
+    template <typename T>
+    void destroy(T* object)
+    {
+        m_segment->destroy_ptr(object);
+    }
+
+
+    template <typename T>
+    Arena_handle<T> handle(const T* object) const
+    {
+        if (!object) {
+            return Arena_handle<T>{0};
+        }
+        assert(m_segment->belongs_to_segment(object));
+        return Arena_handle<T>{uint64_t((const char*)object - base())};
+    }
+
+
+    template <typename T>
+    T* resolve(Arena_handle<T> h) const
+    {
+        return h ? (T*)(base() + h.offset) : nullptr;
+    }
+
+
+private:
+
+    const char* base() const { return (const char*)m_segment->get_address(); }
+
+
+    struct Memory_resource: std::pmr::memory_resource
+    {
+        void* do_allocate(size_t num_bytes, size_t alignment) override
+        {
+            return m_segment_manager->allocate_aligned(num_bytes, alignment);
+        }
+
+        void do_deallocate(void* p, size_t, size_t) override
+        {
+            m_segment_manager->deallocate(p);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+        {
+            return this == &other;
+        }
+
+        segment_manager_type* m_segment_manager = nullptr;
+    };
+
+
+    segment_type*                       m_segment               = nullptr;
+    bool                                m_at_common_address     = false;
+    Memory_resource                     m_resource;
+};
+
+
+
+// Containers using offset pointers, which may be shared among processes regardless of the
+// address the arena is mapped at.
+template <typename T>
+using arena_allocator   = ipc::allocator<T, Shared_arena::segment_manager_type>;
+
+template <typename T>
+using arena_vector      = ipc::vector<T, arena_allocator<T>>;
+
+using arena_string      = ipc::basic_string<char, std::char_traits<char>, arena_allocator<char>>;
+
+
+} // namespace sintra
+
+
+#endif
@@ -83,6 +83,15 @@ std::vector<Process_descriptor> make_branches(const Process_descriptor& pd, Args
 
 
 
+inline
+void enable_mesh()
+{
+    assert(!s_mproc); // must be called before init()
+    s_mesh = true;
+}
+
+
+
 inline
 void init(int argc, char* argv[], std::vector<Process_descriptor> v = std::vector<Process_descriptor>())
 {
@@ -142,6 +151,9 @@ int process_index()
 // This is a convenience function.
 bool barrier(const std::string& barrier_name, const std::string& group_name)
 {
+    // the barrier waits for the other processes, thus only an explicit timeout applies
+    Rpc_timeout timeout(Rpc_timeout::scoped_or(0.));
+
     auto flush_seq = Process_group::rpc_barrier(group_name, barrier_name);
     if (flush_seq == invalid_sequence) {
         return false;
@@ -151,6 +163,11 @@ bool barrier(const std::string& barrier_name, const std::string& group_name)
     // (i.e. all messages on the coordinator's channel must be processed before proceeding further)
     if (!s_coord) {
         s_mproc->flush(process_of(s_coord_id), flush_seq);
+
+        // in mesh mode, the messages of the other processes are read from their own rings
+        if (s_mesh) {
+            s_mproc->flush_peers();
+        }
     }
 
     return true;
@@ -164,6 +181,13 @@ auto activate_slot(const FT& slot_function, Typed_instance_id<SENDER_T> sender_i
 }
 
 
+template <typename FT, typename SENDER_T>
+auto activate_batch_slot(const FT& slot_function, Typed_instance_id<SENDER_T> sender_id)
+{
+    return s_mproc->activate_batch(slot_function, sender_id);
+}
+
+
 inline
 void deactivate_all_slots()
 {
@@ -171,6 +195,42 @@ void deactivate_all_slots()
 }
 
 
+inline
+void set_local_delivery(Local_delivery delivery)
+{
+    s_mproc->m_local_delivery = delivery;
+}
+
+
+inline
+void set_rpc_timeout(double seconds)
+{
+    Rpc_timeout::s_default = seconds;
+}
+
+
+inline
+void set_rpc_spin_period(double seconds)
+{
+    s_rpc_spin_period = seconds;
+}
+
+
+template <typename T>
+vector<instance_id_type> instances_of()
+{
+    return Coordinator::rpc_instances_of_type(s_coord_id, get_type_id<T>());
+}
+
+
+// The swarm-wide shared arena. See shared_arena.h
+inline
+Shared_arena& shared_arena()
+{
+    return s_mproc->arena();
+}
+
+
 
 template <instance_id_type LOCALITY>
 struct Maildrop
@@ -27,17 +27,28 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define SINTRA_TRANSCEIVER
 
 
+#include "deferred.h"
 #include "globals.h"
 #include "id_types.h"
 #include "message.h"
+#include "return_handlers.h"
+#include "rpc_stream.h"
 #include "spinlocked_containers.h"
 
+#include <atomic>
 #include <condition_variable>
+#include <stdexcept>
+#include <exception>
 #include <functional>
+#include <future>
 #include <list>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <tuple>
+#include <type_traits>
 #include <unordered_map>
+#include <vector>
 
 #include <boost/bind.hpp>
 #include <boost/type_traits.hpp>
@@ -46,6 +57,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 namespace sintra {
 
 
+struct Executor;
+
+
+using std::atomic;
 using std::condition_variable;
 using std::function;
 using std::is_base_of;
@@ -58,6 +73,7 @@ using std::recursive_mutex;
 using std::remove_reference;
 using std::string;
 using std::unordered_map;
+using std::vector;
 
 
 
@@ -180,6 +196,179 @@ using handler_registry_type =
     >;
 
 
+using batch_handler_registry_type =
+    spinlocked_umap <
+        type_id_type,                                    // message type
+        spinlocked_umap <
+            instance_id_type,                            // sender
+            list<function<void(Message_prefix* const*, size_t)>>
+        >
+    >;
+
+
+// The outcome handlers of an asynchronous RPC call (see rpc_async_<m>). Exactly one of them is
+// called, either from the thread reading the replies, or from the calling thread, if the call
+// completes before rpc_async returns (e.g. when the instance is local). Since the thread
+// reading the replies would otherwise stall, they should not block, nor make synchronous
+// RPC calls.
+template <typename T>
+struct Rpc_completion
+{
+    function<void(T)>                   on_return;
+    function<void(std::exception_ptr)>  on_failure;
+};
+
+
+template <>
+struct Rpc_completion<void>
+{
+    function<void()>                    on_return;
+    function<void(std::exception_ptr)>  on_failure;
+};
+
+
+// Makes a completion that fulfills the specified future.
+template <typename T>
+Rpc_completion<T> make_rpc_completion(std::future<T>& future)
+{
+    auto promise = std::make_shared<std::promise<T>>();
+    future = promise->get_future();
+
+    Rpc_completion<T> ret;
+    if constexpr (std::is_void_v<T>) {
+        ret.on_return = [promise]() { promise->set_value(); };
+    }
+    else {
+        ret.on_return = [promise](T v) { promise->set_value(std::move(v)); };
+    }
+    ret.on_failure = [promise](std::exception_ptr e) { promise->set_exception(e); };
+    return ret;
+}
+
+
+
+// The time a synchronous RPC call spins for its reply, in seconds, before it blocks.
+// See set_rpc_spin_period()
+static inline atomic<double> s_rpc_spin_period = 0.;
+
+
+
+// Thrown by a synchronous RPC call whose reply did not arrive in time (see Rpc_timeout).
+class rpc_timeout_exception: public std::runtime_error
+{
+public:
+    rpc_timeout_exception(): std::runtime_error("RPC timed out") {}
+};
+
+
+
+// Limits the time synchronous RPC calls made by the constructing thread wait for their reply,
+// for as long as it exists. Scopes may be nested. Outside any scope, the timeout set with
+// set_rpc_timeout() applies. A timeout of zero waits indefinitely, which is the default.
+// A call that times out throws rpc_timeout_exception, and its reply is ignored if it arrives.
+struct Rpc_timeout
+{
+    explicit Rpc_timeout(double seconds):
+        m_previous(s_tl_timeout)
+    {
+        s_tl_timeout = seconds;
+    }
+
+    ~Rpc_timeout()
+    {
+        s_tl_timeout = m_previous;
+    }
+
+    Rpc_timeout(const Rpc_timeout&) = delete;
+    const Rpc_timeout& operator = (const Rpc_timeout&) = delete;
+
+
+    // The timeout of the calls made by the calling thread, in seconds.
+    static double current() { return s_tl_timeout >= 0. ? s_tl_timeout : s_default.load(); }
+
+    // The timeout of the innermost scope, or the specified one, if there is no scope.
+    static double scoped_or(double seconds) { return s_tl_timeout >= 0. ? s_tl_timeout : seconds; }
+
+    inline static atomic<double>        s_default       = 0.;
+
+private:
+    double                              m_previous;
+    inline static thread_local double   s_tl_timeout    = -1.;  // negative if not in a scope
+};
+
+
+
+template<typename T> struct unvoid       { using type = T;                  };
+template<>           struct unvoid<void> { using type = void_placeholder_t; };
+
+
+
+// The outcome of a group call (see rpc_gather_<m>) for one of its members. error is null if
+// the call succeeded.
+struct Member_status
+{
+    instance_id_type                    instance_id     = invalid_instance_id;
+    std::exception_ptr                  error;
+
+    bool succeeded() const { return !error; }
+};
+
+
+template <typename T>
+struct Member_result: Member_status
+{
+    T                                   value           = T();
+};
+
+
+template <>
+struct Member_result<void>: Member_status
+{
+};
+
+
+// The outcome of a reducing group call (see rpc_reduce_<m>). The value includes the results
+// of the members that succeeded, and the status lists all members, in the order they were
+// specified.
+template <typename T>
+struct Rpc_reduction
+{
+    T                                   value;
+    vector<Member_status>               status;
+};
+
+
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#define SINTRA_COROUTINES
+#endif
+
+
+#ifdef SINTRA_COROUTINES
+
+// See coroutines.h
+template <typename T>
+struct Rpc_awaitable;
+
+#define SINTRA_RPC_CO_IMPL(m, mfp)                                                              \
+    template<typename... Args>                                                                  \
+    static auto rpc_co_ ## m (Resolvable_instance_id instance_id, Args&&... args)               \
+    {                                                                                           \
+        using r_type = typename m ## _mftc::r_type;                                             \
+        return sintra::Rpc_awaitable<r_type>(                                                   \
+            [instance_id, args...](sintra::Rpc_completion<r_type> completion) {                 \
+                rpc_async<m ## _mftc>(mfp, std::move(completion), instance_id, args...);        \
+            });                                                                                 \
+    }
+
+#else
+
+#define SINTRA_RPC_CO_IMPL(m, mfp)
+
+#endif
+
+
+
 struct Transceiver
 {
     using Transceiver_type = Transceiver;
@@ -214,9 +403,23 @@ public:
         message_string what
     )
 
+    // Emitted by the callee of a one-way function that failed, since there is no reply to
+    // deliver the exception to. It is addressed to the process of the caller only, and since
+    // one-way calls carry no id, a failure can only be matched to the function that failed,
+    // by function_type_id, not to the call. See SINTRA_RPC_ONEWAY
     SINTRA_SIGNAL_EXPLICIT(
-        deferral,
-        instance_id_type new_fiid
+        oneway_rpc_failure,
+        instance_id_type caller_instance_id,
+        type_id_type function_type_id,
+        type_id_type exception_type_id,
+        message_string what
+    )
+
+    // Sent by the caller of a streamed function to the process of the callee, to let it write
+    // more items, or to cancel the stream, if the credit is zero. See rpc_stream.h
+    SINTRA_SIGNAL_EXPLICIT(
+        rpc_stream_credit,
+        uint32_t credit
     )
 
     list<function<void()>> m_deactivators;
@@ -230,6 +433,30 @@ public:
         decltype(m_deactivators)::iterator* deactivator_it_ptr = nullptr);
 
 
+    // Adds a handler to the specified registry, and makes its deactivator.
+    template<typename REGISTRY_T, typename HANDLER_T>
+    handler_deactivator add_handler(
+        REGISTRY_T& registry,
+        const HANDLER_T& handler,
+        type_id_type message_type_id,
+        instance_id_type sender_id,
+        decltype(m_deactivators)::iterator* deactivator_it_ptr);
+
+
+    // A functor taking a Message_batch argument. Whenever consecutive messages of the handled
+    // type are read together from a ring, the functor is called once, with all of them (or all
+    // of those sent by the specified sender). Handlers of individual messages of the same type
+    // are called before it.
+    template<
+        typename SENDER_T,
+        typename FT,
+        typename BATCH_T = std::decay_t<decltype(resolve_single_functor_arg(*((FT*)0)))>
+    >
+    handler_deactivator activate_batch(
+        const FT& internal_slot,
+        Typed_instance_id<SENDER_T> sender_id);
+
+
     // A functor with an arbitrary non-message argument
     template<
         typename SENDER_T,
@@ -340,7 +567,8 @@ public:
     struct RPCTC_d // remote process call type container
     {
         using mf_type = MF;
-        using r_type = RT;
+        using mf_r_type = RT;   // the return type of the function, which may be deferred
+        using r_type = typename undeferred<RT>::type;
         using o_type = OBJECT_T;
         const static MF mf() { return m; };
         static constexpr type_id_type id = ID;
@@ -348,6 +576,50 @@ public:
     };
 
 
+    // The type container of a batch of calls to the function of RPCTC (see rpc_batch_<m>).
+    // A batch is a function of its own, taking a vector of argument tuples and returning a
+    // vector of results, which is never called directly.
+    template <typename RPCTC, typename... Args>
+    struct RPCTC_batch
+    {
+        using base = RPCTC;
+        using tuple_type = std::tuple<std::decay_t<Args>...>;
+        using r_type = std::conditional_t<
+            std::is_void_v<typename RPCTC::r_type>,
+            void,
+            vector<typename RPCTC::r_type>
+        >;
+        using mf_r_type = r_type;
+        using o_type = typename RPCTC::o_type;
+        static constexpr type_id_type id = invalid_type_id;
+        static constexpr bool may_be_called_directly = false;
+
+        // Batches are written as plain arrays, thus they only hold trivially copyable types.
+        // Functions with deferred results are excluded, since the handler would have to wait.
+        static constexpr bool is_supported =
+            (std::is_trivially_copyable_v<std::decay_t<Args>> && ...) &&
+            (std::is_void_v<typename RPCTC::r_type> ||
+                std::is_trivially_copyable_v<typename RPCTC::r_type>) &&
+            !undeferred<typename RPCTC::mf_r_type>::is_deferred;
+    };
+
+
+    template <typename RPCTC, typename MF>
+    struct batch_of;
+
+    template <typename RPCTC, typename RT, typename OBJECT_T, typename... Args>
+    struct batch_of<RPCTC, RT(OBJECT_T::*)(Args...)>
+    {
+        using type = RPCTC_batch<RPCTC, Args...>;
+    };
+
+    template <typename RPCTC, typename RT, typename OBJECT_T, typename... Args>
+    struct batch_of<RPCTC, RT(OBJECT_T::*)(Args...) const>
+    {
+        using type = RPCTC_batch<RPCTC, Args...>;
+    };
+
+
     // Short note: It is fairly simple to change the message body from boost::fusion::vector to
     // std::tuple, to avoid yet another boost dependency, but be aware of the implications.
     // The implementation of fusion::vector is a plain struct. The tuple on the other hand will most
@@ -455,6 +727,74 @@ public:
     static void rpc_handler(Message_prefix& untyped_msg);
 
 
+    // The handler of the batches of calls to the function of RPCTC. See rpc_batch()
+    template <
+        typename RPCTC,
+        typename MESSAGE_T
+    >
+    static void rpc_batch_handler(Message_prefix& untyped_msg);
+
+
+    template <
+        typename RPCTC,
+        typename MESSAGE_T
+    >
+    static void execute_rpc_batch(MESSAGE_T& msg, typename RPCTC::o_type* obj);
+
+
+    // Calls the exported function and writes the reply. This is done by rpc_handler, either
+    // directly or through the executor of the object.
+    template <
+        typename RPCTC,
+        typename MESSAGE_T
+    >
+    static void execute_rpc(MESSAGE_T& msg, typename RPCTC::o_type* obj);
+
+
+    // The handler of the calls to a function returning a stream. See rpc_stream.h
+    template <
+        typename RPCTC,
+        typename MESSAGE_T
+    >
+    static void rpc_stream_handler(Message_prefix& untyped_msg);
+
+
+    template <
+        typename RPCTC,
+        typename MESSAGE_T
+    >
+    static void execute_rpc_stream(MESSAGE_T& msg, typename RPCTC::o_type* obj);
+
+
+    // Handles oneway_rpc_failure, in the process of the caller.
+    inline
+    static void oneway_rpc_failure_handler(Message_prefix& m);
+
+
+    // Handles rpc_stream_credit, in the process of the callee.
+    inline
+    static void rpc_stream_credit_handler(Message_prefix& untyped_msg);
+
+
+    // Writes items of the stream, for as long as it has credit, on the calling thread.
+    inline
+    static void pump_rpc_stream(const shared_ptr<Outgoing_rpc_stream>& os);
+
+
+    // Writes the reply of a call, or for one-way calls, emits their failure. The value is
+    // ignored if etid identifies an exception. This may be called from any thread, once a
+    // deferred result is complete.
+    template <typename RPCTC>
+    static void write_rpc_reply(
+        typename RPCTC::o_type* obj,
+        instance_id_type receiver_iid,
+        instance_id_type function_iid,
+        type_id_type function_type_id,
+        const typename unvoid<typename RPCTC::r_type>::type* value,
+        type_id_type etid,
+        const string& what);
+
+
     template <
         typename RPCTC,
         typename RT,
@@ -462,7 +802,7 @@ public:
         typename... FArgs,      // The argument types of the exported member function
         typename... RArgs        // The argument types used by the caller
     >
-    static RT rpc(
+    static typename RPCTC::r_type rpc(
         RT(OBJECT_T::* /*resolution dummy arg*/)(FArgs...),
         instance_id_type instance_id,
         RArgs&&... args);
@@ -475,12 +815,19 @@ public:
         typename... FArgs,
         typename... RArgs
     >
-    static RT rpc(
+    static typename RPCTC::r_type rpc(
         RT(OBJECT_T::* /*resolution dummy arg*/)(FArgs...) const,
         instance_id_type instance_id,
         RArgs&&... args);
 
 
+    // Calls an exported function of a local instance, rather than through the rings. If the
+    // function returns a deferred result, it waits for it, thus this is only meant for
+    // synchronous calls. Asynchronous calls forward the token instead (see rpc_async_impl).
+    template <typename RPCTC, typename... Args>
+    static typename RPCTC::r_type call_directly(typename RPCTC::o_type* obj, const Args&... args);
+
+
     template <
         typename RPCTC,
         typename MESSAGE_T,
@@ -489,32 +836,220 @@ public:
     static auto rpc_impl(instance_id_type instance_id, Args... args) -> typename RPCTC::r_type;
 
 
+    // Asynchronous RPC. The call is written to the ring and the function returns, without
+    // waiting for the reply, which is delivered through the completion. Thus a single thread
+    // may have any number of calls in flight, to any number of instances.
+    // Returns the function instance id of the call, which Managed_process::abort_rpc() takes,
+    // or invalid_instance_id if the call was not written to the ring (e.g. a direct call).
+    template <
+        typename RPCTC,
+        typename RT,
+        typename OBJECT_T,
+        typename... FArgs,
+        typename... RArgs
+    >
+    static instance_id_type rpc_async(
+        RT(OBJECT_T::* /*resolution dummy arg*/)(FArgs...),
+        Rpc_completion<typename RPCTC::r_type> completion,
+        instance_id_type instance_id,
+        RArgs&&... args);
+
+
+    template <
+        typename RPCTC,
+        typename RT,
+        typename OBJECT_T,
+        typename... FArgs,
+        typename... RArgs
+    >
+    static instance_id_type rpc_async(
+        RT(OBJECT_T::* /*resolution dummy arg*/)(FArgs...) const,
+        Rpc_completion<typename RPCTC::r_type> completion,
+        instance_id_type instance_id,
+        RArgs&&... args);
+
+
+    template <
+        typename RPCTC,
+        typename MESSAGE_T,
+        typename... Args
+    >
+    static instance_id_type rpc_async_impl(
+        instance_id_type instance_id,
+        Rpc_completion<typename RPCTC::r_type> completion,
+        Args... args);
+
+
+
+    // One-way RPC, for functions returning void. The call is written to the ring with no
+    // function instance id, which tells the callee not to reply, and the function returns
+    // without waiting. Failures are sent by the callee to the process of the caller, as
+    // oneway_rpc_failure.
+    template <
+        typename RPCTC,
+        typename RT,
+        typename OBJECT_T,
+        typename... FArgs,
+        typename... RArgs
+    >
+    static void rpc_oneway(
+        RT(OBJECT_T::* /*resolution dummy arg*/)(FArgs...),
+        instance_id_type instance_id,
+        RArgs&&... args);
+
+
+    template <
+        typename RPCTC,
+        typename RT,
+        typename OBJECT_T,
+        typename... FArgs,
+        typename... RArgs
+    >
+    static void rpc_oneway(
+        RT(OBJECT_T::* /*resolution dummy arg*/)(FArgs...) const,
+        instance_id_type instance_id,
+        RArgs&&... args);
+
+
+    template <
+        typename RPCTC,
+        typename MESSAGE_T,
+        typename... Args
+    >
+    static void rpc_oneway_impl(instance_id_type instance_id, Args... args);
+
+
+    // Streamed RPC, for functions returning stream<T>. The call is written like any other,
+    // and the items are read from the returned Rpc_stream<T>, as they arrive.
+    template <
+        typename RPCTC,
+        typename RT,
+        typename OBJECT_T,
+        typename... FArgs,
+        typename... RArgs
+    >
+    static Rpc_stream<typename RT::value_type> rpc_stream(
+        RT(OBJECT_T::* /*resolution dummy arg*/)(FArgs...),
+        instance_id_type instance_id,
+        RArgs&&... args);
 
-    struct Return_handler
-    {
-        function<void(const Message_prefix&)>   return_handler;
-        function<void(const Message_prefix&)>   exception_handler;
-        function<void(const Message_prefix&)>   deferral_handler;
-        instance_id_type                        instance_id = 0;
-    };
+
+    template <
+        typename RPCTC,
+        typename RT,
+        typename OBJECT_T,
+        typename... FArgs,
+        typename... RArgs
+    >
+    static Rpc_stream<typename RT::value_type> rpc_stream(
+        RT(OBJECT_T::* /*resolution dummy arg*/)(FArgs...) const,
+        instance_id_type instance_id,
+        RArgs&&... args);
 
 
+    template <
+        typename RPCTC,
+        typename MESSAGE_T,
+        typename... Args
+    >
+    static Rpc_stream<typename RPCTC::r_type::value_type> rpc_stream_impl(
+        instance_id_type instance_id, Args... args);
+
+
+    // Grants credit to the stream of the specified call, or cancels it, if the credit is zero.
+    inline
+    static void grant_rpc_stream_credit(
+        instance_id_type callee_iid,
+        instance_id_type function_iid,
+        uint32_t credit);
+
+
+    // Batched RPC. The argument tuples of many calls to the same function are written in a
+    // single request message, the function is called for each of them by a single handler
+    // invocation, and their results are returned in a single reply, in the same order.
+    // The arguments and the result must be trivially copyable. If any of the calls throws,
+    // the calls after it are not made, and the whole batch fails with its exception.
+    template <typename RPCTC>
+    static auto rpc_batch(
+        instance_id_type instance_id,
+        const vector<typename batch_of<RPCTC, typename RPCTC::mf_type>::type::tuple_type>& calls)
+        -> typename batch_of<RPCTC, typename RPCTC::mf_type>::type::r_type;
+
+
+    // Group RPC. The call is written to each of the instances, without waiting for any of them
+    // to return, then the caller waits for all the replies. on_result(i, value) and
+    // on_failure(i, exception) are called as the replies arrive, one at a time, from whichever
+    // thread delivers them. Members that have not replied by the timeout of the calling thread
+    // (see Rpc_timeout) fail with rpc_timeout_exception, and their late replies are ignored.
+    template <
+        typename RPCTC,
+        typename MF,
+        typename ON_RESULT,
+        typename ON_FAILURE,
+        typename... Args
+    >
+    static void rpc_scatter(
+        MF mf,
+        const vector<instance_id_type>& instances,
+        ON_RESULT on_result,
+        ON_FAILURE on_failure,
+        const Args&... args);
+
+
+    template <typename RPCTC, typename MF, typename... Args>
+    static auto rpc_gather(MF mf, const vector<instance_id_type>& instances, const Args&... args)
+        -> vector<Member_result<typename RPCTC::r_type>>;
+
+
+    template <typename RPCTC, typename MF, typename T, typename F, typename... Args>
+    static Rpc_reduction<T> rpc_reduce(
+        MF mf,
+        const vector<instance_id_type>& instances,
+        T init,
+        F reduce,
+        const Args&... args);
+
+
+
+    // See return_handlers.h
     inline
     instance_id_type activate_return_handler(const Return_handler &rh);
 
     inline
     void deactivate_return_handler(instance_id_type function_instance_id);
 
-    // useful for deferred
-    void replace_return_handler_id(instance_id_type old_id, instance_id_type new_id);
+
+    // Runs the exported functions of this transceiver on the specified executor, rather than on
+    // the reader thread. If ordered is true, the calls of each caller are handled in the order
+    // in which they were made. A null executor restores the default. See executor.h
+    void set_rpc_executor(Executor* executor, bool ordered = true)
+    {
+        m_rpc_ordered = ordered;
+        m_rpc_executor = executor;
+    }
 
 
     template <typename RPCTC, typename MT>
     function<void()> export_rpc_impl();
 
+    // Registers the handler of the batches of calls to the function of RPCTC, if the function
+    // can be batched at all. Called once per function, from export_rpc_impl().
+    template <typename RPCTC>
+    static void export_rpc_batch();
+
     template <typename RPCTC, typename RT, typename OBJECT_T, typename... Args>
     function<void()> export_rpc(RT(OBJECT_T::* /*resolution dummy arg*/)(Args...) const);
 
+    // Registers the handler of a function returning a stream. See SINTRA_RPC_STREAM
+    template <typename RPCTC, typename MT>
+    function<void()> export_rpc_stream_impl();
+
+    template <typename RPCTC, typename RT, typename OBJECT_T, typename... Args>
+    function<void()> export_rpc_stream(RT(OBJECT_T::* /*resolution dummy arg*/)(Args...) const);
+
+    template <typename RPCTC, typename RT, typename OBJECT_T, typename... Args>
+    function<void()> export_rpc_stream(RT(OBJECT_T::* /*resolution dummy arg*/)(Args...));
+
     template <typename RPCTC, typename RT, typename OBJECT_T, typename... Args>
     function<void()> export_rpc(RT(OBJECT_T::* /*resolution dummy arg*/)(Args...));
 
@@ -535,9 +1070,104 @@ public:
     static auto rpc_ ## m (Resolvable_instance_id instance_id, Args&&... args)                  \
     {                                                                                           \
         return rpc<m ## _mftc>(mfp, instance_id, args...);                                      \
+    }                                                                                           \
+                                                                                                \
+    template<typename... Args>                                                                  \
+    static auto rpc_async_ ## m (Resolvable_instance_id instance_id, Args&&... args)            \
+    {                                                                                           \
+        std::future<typename m ## _mftc::r_type> ret;                                           \
+        rpc_async<m ## _mftc>(mfp, sintra::make_rpc_completion(ret), instance_id, args...);     \
+        return ret;                                                                             \
+    }                                                                                           \
+                                                                                                \
+    template<typename... Args>                                                                  \
+    static void rpc_async_ ## m (                                                               \
+        sintra::Rpc_completion<typename m ## _mftc::r_type> completion,                         \
+        Resolvable_instance_id instance_id, Args&&... args)                                     \
+    {                                                                                           \
+        rpc_async<m ## _mftc>(mfp, std::move(completion), instance_id, args...);                \
+    }                                                                                           \
+                                                                                                \
+    using m ## _batch = typename batch_of<m ## _mftc, decltype(mfp)>::type;                     \
+                                                                                                \
+    template<typename BATCH = m ## _batch>                                                      \
+    static auto rpc_batch_ ## m (                                                               \
+        Resolvable_instance_id instance_id,                                                     \
+        const std::vector<typename BATCH::tuple_type>& calls)                                   \
+    {                                                                                           \
+        return rpc_batch<typename BATCH::base>(instance_id, calls);                             \
+    }                                                                                           \
+                                                                                                \
+    template<typename... Args>                                                                  \
+    static auto rpc_gather_ ## m (                                                              \
+        const std::vector<sintra::instance_id_type>& instances, Args&&... args)                 \
+    {                                                                                           \
+        return rpc_gather<m ## _mftc>(mfp, instances, args...);                                 \
+    }                                                                                           \
+                                                                                                \
+    template<typename T, typename F, typename... Args>                                          \
+    static auto rpc_reduce_ ## m (                                                              \
+        const std::vector<sintra::instance_id_type>& instances, T init, F reduce,               \
+        Args&&... args)                                                                         \
+    {                                                                                           \
+        return rpc_reduce<m ## _mftc>(mfp, instances, std::move(init), std::move(reduce),       \
+            args...);                                                                           \
+    }                                                                                           \
+                                                                                                \
+    SINTRA_RPC_CO_IMPL(m, mfp)
+
+
+#define SINTRA_RPC_ONEWAY_IMPL(m, mfp, id, mbcd)                                                \
+    void rpc_assertion_##m() {                                                                  \
+        static_assert(std::is_same_v<                                                           \
+            std::remove_pointer_t<decltype(this)>,                                              \
+            Transceiver_type>,                                                                  \
+            "This Transceiver is not derived correctly."                                        \
+        );                                                                                      \
+    }                                                                                           \
+    using m ## _mftc = RPCTC_d<decltype(mfp), mfp, id, mbcd>;                                   \
+    static_assert(std::is_void_v<typename m ## _mftc::r_type>,                                  \
+        "A function exported as one-way must return void.");                                   \
+    Instantiator m ## _itt = export_rpc<m ## _mftc>(mfp);                                       \
+                                                                                                \
+    template<typename... Args>                                                                  \
+    static void rpc_ ## m (Resolvable_instance_id instance_id, Args&&... args)                  \
+    {                                                                                           \
+        rpc_oneway<m ## _mftc>(mfp, instance_id, args...);                                      \
     }
 
-    
+
+#define SINTRA_RPC_STREAM_IMPL(m, mfp, id, mbcd)                                                \
+    void rpc_assertion_##m() {                                                                  \
+        static_assert(std::is_same_v<                                                           \
+            std::remove_pointer_t<decltype(this)>,                                              \
+            Transceiver_type>,                                                                  \
+            "This Transceiver is not derived correctly."                                        \
+        );                                                                                      \
+    }                                                                                           \
+    using m ## _mftc = RPCTC_d<decltype(mfp), mfp, id, mbcd>;                                   \
+    static_assert(sintra::is_stream<typename m ## _mftc::r_type>::value,                        \
+        "A function exported as a stream must return a stream<T>.");                           \
+    Instantiator m ## _itt = export_rpc_stream<m ## _mftc>(mfp);                                \
+                                                                                                \
+    template<typename... Args>                                                                  \
+    static auto rpc_ ## m (Resolvable_instance_id instance_id, Args&&... args)                  \
+    {                                                                                           \
+        return rpc_stream<m ## _mftc>(mfp, instance_id, args...);                               \
+    }                                                                                           \
+                                                                                                \
+    template<typename... Args>                                                                  \
+    static void rpc_ ## m (                                                                     \
+        std::function<void(const typename m ## _mftc::r_type::value_type&)> on_item,            \
+        Resolvable_instance_id instance_id, Args&&... args)                                     \
+    {                                                                                           \
+        auto s = rpc_stream<m ## _mftc>(mfp, instance_id, args...);                             \
+        for (auto& v : s) {                                                                     \
+            on_item(v);                                                                         \
+        }                                                                                       \
+    }
+
+
     // Exports a member function for RPC.
     #define SINTRA_RPC(m)                                                                       \
         SINTRA_RPC_IMPL(m, &Transceiver_type :: m, invalid_type_id, true)
@@ -562,6 +1192,21 @@ public:
     #define SINTRA_RPC_ONLY_EXPLICIT(m)                                                         \
         SINTRA_RPC_IMPL(m, &Transceiver_type :: m, (type_id_type)sintra::detail::reserved_id::m, false)
 
+    // Exports a member function returning void for one-way RPC. The caller does not wait for
+    // the function to return, and the callee does not reply, thus the call costs a single
+    // message. If the function throws, the callee sends oneway_rpc_failure to the process of
+    // the caller, which identifies the function but not the call. As with SINTRA_RPC, calls to
+    // a local instance are direct, thus they are synchronous.
+    #define SINTRA_RPC_ONEWAY(m)                                                                \
+        SINTRA_RPC_ONEWAY_IMPL(m, &Transceiver_type :: m, invalid_type_id, true)
+
+    // Exports a member function returning stream<T>, whose items are delivered to the caller
+    // one reply at a time, with flow control (see rpc_stream.h). rpc_<m>(instance, args...)
+    // returns an Rpc_stream<T>, and rpc_<m>(on_item, instance, args...) calls on_item for
+    // each item, until the end of the stream. Calls are never direct, even if local.
+    #define SINTRA_RPC_STREAM(m)                                                                \
+        SINTRA_RPC_STREAM_IMPL(m, &Transceiver_type :: m, invalid_type_id, false)
+
   //\       //\       //\       //\       //\       //\       //\       //
  ////\     ////\     ////\     ////\     ////\     ////\     ////\     ////
 //////\   //////\   //////\   //////\   //////\   //////\   //////\   //////
@@ -576,14 +1221,17 @@ private:
     // Note that the key is an instance_id_type, rather than a type_id_type.
     // Those message handlers identify with particular function message invocations, and their
     // lifetime ends with the end of the call.
-    // They are assigned in pairs, to handle successful and failed calls.
-    mutex m_return_handlers_mutex;
-    unordered_map<instance_id_type, Return_handler> m_active_return_handlers;
+    // They are assigned in pairs, to handle successful and failed calls, along with the handler
+    // of aborted calls.
+    Return_handler_table m_return_handlers;
 
 
     instance_id_type            m_instance_id       = invalid_instance_id;
     bool                        m_published         = false;
 
+    atomic<Executor*>           m_rpc_executor      = nullptr;
+    bool                        m_rpc_ordered       = true;
+
     spinlocked_umap<string, instance_id_type>::iterator m_cache_iterator;
 
 
@@ -702,13 +1350,12 @@ struct Outstanding_rpc_control
     mutex               keep_waiting_mutex;
     condition_variable  keep_waiting_condition;
 
-    // this is set before the rpc is written to the ring, in rpc_impl.
-    // It is meant to identify the remote instance, in case it
-    // crashes, in order to unblock the local caller.
-    instance_id_type    remote_instance = invalid_instance_id;
-
     bool                keep_waiting = true;
     bool                success = false;
+
+    // Set along with keep_waiting, for callers that spin, rather than wait on the condition
+    // (see set_rpc_spin_period()).
+    atomic<bool>        completed = false;
 };
 
 
@@ -27,8 +27,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define SINTRA_TRANSCEIVER_IMPL_H
 
 
+#include <chrono>
 #include <type_traits>
 #include <memory>
+#include <optional>
 
 #include "exception_conversions.h"
 #include "exception_conversions_impl.h"
@@ -124,6 +126,7 @@ void Transceiver::destroy()
 
     if (this != s_mproc) {
         deactivate_all();
+        s_mproc->abandon_rpc_streams(m_instance_id, invalid_instance_id);
     }
 
     if (m_published) {
@@ -156,36 +159,48 @@ Transceiver::activate_impl(
     HT&& handler,
     instance_id_type sender_id,
     decltype(m_deactivators)::iterator* deactivator_it_ptr)
+{
+    return add_handler(
+        s_mproc->m_active_handlers,
+        (function<void(const Message_prefix&)>&) handler,
+        MESSAGE_T::id(),
+        sender_id,
+        deactivator_it_ptr);
+}
+
+
+
+template<typename REGISTRY_T, typename HANDLER_T>
+Transceiver::handler_deactivator
+Transceiver::add_handler(
+    REGISTRY_T& registry,
+    const HANDLER_T& handler,
+    type_id_type message_type_id,
+    instance_id_type sender_id,
+    decltype(m_deactivators)::iterator* deactivator_it_ptr)
 {
     // an invalid instance must never be passed to this function (must be checked earlier)
     assert(sender_id != invalid_instance_id);
 
-    auto message_type_id = MESSAGE_T::id();
-
     lock_guard<recursive_mutex> sl(s_mproc->m_handlers_mutex);
 
-    auto& ms  = s_mproc->m_active_handlers[message_type_id];
-    list<function<void(const Message_prefix &)>>::iterator mid_sid_it;
+    auto& ms  = registry[message_type_id];
+    typename list<HANDLER_T>::iterator mid_sid_it;
 
     auto  msm_it = ms.find(sender_id);
     if (msm_it == ms.end()) {
 
         // There was no record for this sender_id, thus we have to make one.
 
-        msm_it = ms.emplace(
-            sender_id,
-            list<function<void(const Message_prefix&)>> {
-                (function<void(const Message_prefix&)>&) handler
-            }
-        ).first;
+        msm_it = ms.emplace(sender_id, list<HANDLER_T> { handler }).first;
         mid_sid_it = msm_it->second.begin();
     }
     else {
-        mid_sid_it = msm_it->second.emplace(msm_it->second.end(),
-            (function<void(const Message_prefix&)>&) handler
-        );
+        mid_sid_it = msm_it->second.emplace(msm_it->second.end(), handler);
     }
 
+    s_mproc->publish_handlers(message_type_id);
+
     decltype(m_deactivators)::iterator deactivator_it;
 
     if (!deactivator_it_ptr) {
@@ -199,12 +214,23 @@ Transceiver::activate_impl(
     }
 
     *deactivator_it = [=, &ms] () {
-        lock_guard<recursive_mutex> sl(s_mproc->m_handlers_mutex);
-        msm_it->second.erase(mid_sid_it);
-        if (msm_it->second.empty()) {
-            ms.erase(msm_it);
+        {
+            lock_guard<recursive_mutex> sl(s_mproc->m_handlers_mutex);
+            msm_it->second.erase(mid_sid_it);
+            if (msm_it->second.empty()) {
+                ms.erase(msm_it);
+            }
+            s_mproc->publish_handlers(message_type_id);
+
+            // this destroys the lambda, thus nothing captured may be accessed after this line
+            m_deactivators.erase(deactivator_it);
+        }
+
+        // A reader thread may still be running the handler, with the previous snapshot.
+        // Readers cannot wait here, as they might be waiting for each other.
+        if (!Handler_dispatch::is_reader_thread()) {
+            s_mproc->m_handler_dispatch.synchronize();
         }
-        m_deactivators.erase(deactivator_it);
     };
 
     return m_deactivators.back();
@@ -212,6 +238,38 @@ Transceiver::activate_impl(
 
 
 
+// A functor taking a batch of messages
+template<
+    typename SENDER_T,
+    typename FT,
+    typename BATCH_T /* = decay_t<decltype(resolve_single_functor_arg(*((FT*)0)))>*/
+>
+Transceiver::handler_deactivator
+Transceiver::activate_batch(
+    const FT& internal_slot,
+    Typed_instance_id<SENDER_T> sender_id)
+{
+    using MT = typename BATCH_T::message_type;
+
+    constexpr bool sender_capability =
+        is_same_v    < SENDER_T, void > ||                   // generic sender (e.g. any_local)
+        is_base_of_v < typename MT::exporter, SENDER_T >;    // the exporter is sender's base
+
+    static_assert(sender_capability, "This type of sender cannot send the type of messages "
+        "handled by the specified handler.");
+
+    function<void(Message_prefix* const*, size_t)> handler =
+        [internal_slot](Message_prefix* const* messages, size_t num_messages)
+    {
+        internal_slot(BATCH_T(messages, num_messages));
+    };
+
+    return add_handler(
+        s_mproc->m_active_batch_handlers, handler, MT::id(), sender_id.id, nullptr);
+}
+
+
+
 // A functor with an arbitrary non-message argument
 template<
     typename SENDER_T,
@@ -413,10 +471,29 @@ void Transceiver::send(Args&&... args)
     static auto once = MESSAGE_T::id();
     (void)(once); // suppress unused variable warning
 
+    // local events do not pass through the rings (see local_events.h)
+    if constexpr (LOCALITY == any_local) {
+        auto lm = make_local_message<MESSAGE_T>(vb_size(args...), args...);
+        lm->message->sender_instance_id = m_instance_id;
+        lm->message->receiver_instance_id = LOCALITY;
+        s_mproc->deliver_locally(lm);
+        return;
+    }
+
     MESSAGE_T* msg = s_mproc->m_out_req_c->write<MESSAGE_T>(vb_size(args...), args...);
     msg->sender_instance_id = m_instance_id;
     msg->receiver_instance_id = LOCALITY;
+
+    Local_message* lm = nullptr;
+    if constexpr (LOCALITY == any_local_or_remote) {
+        lm = copy_to_local_message(*msg);
+    }
+
     s_mproc->m_out_req_c->done_writing();
+
+    if (lm) {
+        s_mproc->deliver_locally(lm);
+    }
 }
 
 
@@ -482,7 +559,7 @@ template <typename T>
 struct Void_filter
 {
     std::function<T()> f;
-    T result;
+    T result{};
     void call() { result = f(); }
 };
 
@@ -490,102 +567,446 @@ template <>
 struct Void_filter<void_placeholder_t>
 {
     std::function<void()> f;
-    void_placeholder_t result;
+    void_placeholder_t result{};
     void call() { f(); }
 };
 
 
-template<typename T> struct unvoid       { using type = T;                  };
-template<>           struct unvoid<void> { using type = void_placeholder_t; };
+template <
+    typename RPCTC,
+    typename MESSAGE_T
+>
+void Transceiver::rpc_handler(Message_prefix& untyped_msg)
+{
+    MESSAGE_T& msg = (MESSAGE_T&)untyped_msg;
+    typename RPCTC::o_type* obj = get_instance_to_object_map<RPCTC>()[untyped_msg.receiver_instance_id];
+
+    Executor* executor = obj->m_rpc_executor;
+    if (!executor) {
+        execute_rpc<RPCTC, MESSAGE_T>(msg, obj);
+        return;
+    }
+
+    // the reader moves on, thus the message must be kept for the executor
+    auto held = hold(msg);
+    auto key = obj->m_rpc_ordered ? msg.sender_instance_id : 0;
+    executor->post([held, obj]() {
+        execute_rpc<RPCTC, MESSAGE_T>(const_cast<MESSAGE_T&>(*held), obj);
+    }, key);
+}
+
+
+
+// Identifies the type of an exception thrown by an exported function, for the caller to
+// throw one of the same type (see string_to_exception()). The message is copied to what.
+inline
+type_id_type rpc_exception_type_id(std::exception_ptr ep, string& what)
+{
+    type_id_type etid = not_defined_type_id;
+    try {
+        std::rethrow_exception(ep);
+    }
+    catch(std::invalid_argument  &e) { etid = (type_id_type)detail::reserved_id::std_invalid_argument; what = e.what(); }
+    catch(std::domain_error      &e) { etid = (type_id_type)detail::reserved_id::std_domain_error;     what = e.what(); }
+    catch(std::length_error      &e) { etid = (type_id_type)detail::reserved_id::std_length_error;     what = e.what(); }
+    catch(std::out_of_range      &e) { etid = (type_id_type)detail::reserved_id::std_out_of_range;     what = e.what(); }
+    catch(std::range_error       &e) { etid = (type_id_type)detail::reserved_id::std_range_error;      what = e.what(); }
+    catch(std::overflow_error    &e) { etid = (type_id_type)detail::reserved_id::std_overflow_error;   what = e.what(); }
+    catch(std::underflow_error   &e) { etid = (type_id_type)detail::reserved_id::std_underflow_error;  what = e.what(); }
+    catch(std::ios_base::failure &e) { etid = (type_id_type)detail::reserved_id::std_ios_base_failure; what = e.what(); }
+    catch(std::logic_error       &e) { etid = (type_id_type)detail::reserved_id::std_logic_error;      what = e.what(); }
+    catch(std::runtime_error     &e) { etid = (type_id_type)detail::reserved_id::std_runtime_error;    what = e.what(); }
+    catch(std::exception         &e) { etid = (type_id_type)detail::reserved_id::std_exception;        what = e.what(); }
+    catch(...)                       { etid = (type_id_type)detail::reserved_id::unknown_exception;    what =
+        "An exception was thrown whose type is not serialized by sintra";
+    }
+    return etid;
+}
+
 
 
 template <
     typename RPCTC,
     typename MESSAGE_T
 >
-void Transceiver::rpc_handler(Message_prefix& untyped_msg)
+void Transceiver::execute_rpc(MESSAGE_T& msg, typename RPCTC::o_type* obj)
+{
+    using r_type = typename unvoid<typename RPCTC::r_type>::type;
+    using mf_r_type = typename unvoid<typename RPCTC::mf_r_type>::type;
+
+    auto vf = Void_filter<mf_r_type>{
+        [&](){return call_function_with_fusion_vector_args(*obj, RPCTC::mf(), msg);}
+    };
+
+    try {
+        vf.call();
+    }
+    catch(...) {
+        string what;
+        auto etid = rpc_exception_type_id(std::current_exception(), what);
+        write_rpc_reply<RPCTC>(obj, msg.sender_instance_id, msg.function_instance_id,
+            msg.message_type_id, (const r_type*)nullptr, etid, what);
+        return;
+    }
+
+    if constexpr (undeferred<mf_r_type>::is_deferred) {
+
+        // the reply is written once the result is complete, which may already be the case
+        auto receiver_iid = msg.sender_instance_id;
+        auto function_iid = msg.function_instance_id;
+        auto function_tid = msg.message_type_id;
+        vf.result.on_completion(
+            [obj, receiver_iid, function_iid, function_tid](const r_type* value, std::exception_ptr ep)
+        {
+            string what;
+            auto etid = ep ? rpc_exception_type_id(ep, what) : not_defined_type_id;
+            write_rpc_reply<RPCTC>(obj, receiver_iid, function_iid, function_tid, value, etid, what);
+        });
+    }
+    else {
+        write_rpc_reply<RPCTC>(obj, msg.sender_instance_id, msg.function_instance_id,
+            msg.message_type_id, &vf.result, not_defined_type_id, string());
+    }
+}
+
+
+
+template <typename RPCTC>
+void Transceiver::write_rpc_reply(
+    typename RPCTC::o_type* obj,
+    instance_id_type receiver_iid,
+    instance_id_type function_iid,
+    type_id_type function_type_id,
+    const typename unvoid<typename RPCTC::r_type>::type* value,
+    type_id_type etid,
+    const string& what)
 {
     using r_type = typename unvoid<typename RPCTC::r_type>::type;
 
-    MESSAGE_T& msg = (MESSAGE_T&)untyped_msg;
-    typename RPCTC::o_type* obj = get_instance_to_object_map<RPCTC>()[untyped_msg.receiver_instance_id];
     using return_message_type = Message<Enclosure<r_type>, void, not_defined_type_id>;
     static auto once = return_message_type::id();
     (void)(once); // suppress unused variable warning
 
-    type_id_type etid = not_defined_type_id;
-    const char* what = "";
-    size_t what_size = 0;
+    // a one-way call, which is not replied to (see SINTRA_RPC_ONEWAY)
+    if (function_iid == invalid_instance_id) {
+        if (etid != not_defined_type_id) {
+            // addressed to the process of the caller, which is the only one interested
+            oneway_rpc_failure* msg = s_mproc->m_out_req_c->write<oneway_rpc_failure>(
+                vb_size(what), receiver_iid, function_type_id, etid, what);
+            msg->sender_instance_id = obj->m_instance_id;
+            msg->receiver_instance_id = process_of(receiver_iid);
+            s_mproc->m_out_req_c->done_writing();
+        }
+        return;
+    }
+
+    if (etid == not_defined_type_id) { // normal return
+        return_message_type* placed_msg = s_mproc->m_out_rep_c->write<return_message_type>(vb_size(*value), *value);
+        finalize_rpc_write(placed_msg, receiver_iid, function_iid, obj, etid);
+    }
+    else {
+        exception* placed_msg = s_mproc->m_out_rep_c->write<exception>(vb_size(what), what);
+        finalize_rpc_write(placed_msg, receiver_iid, function_iid, obj, etid);
+    }
+}
+
+
+
+template <
+    typename RPCTC,
+    typename MESSAGE_T
+>
+void Transceiver::rpc_batch_handler(Message_prefix& untyped_msg)
+{
+    MESSAGE_T& msg = (MESSAGE_T&)untyped_msg;
+    typename RPCTC::o_type* obj =
+        get_instance_to_object_map<typename RPCTC::base>()[untyped_msg.receiver_instance_id];
+
+    Executor* executor = obj->m_rpc_executor;
+    if (!executor) {
+        execute_rpc_batch<RPCTC, MESSAGE_T>(msg, obj);
+        return;
+    }
+
+    // the reader moves on, thus the message must be kept for the executor
+    auto held = hold(msg);
+    auto key = obj->m_rpc_ordered ? msg.sender_instance_id : 0;
+    executor->post([held, obj]() {
+        execute_rpc_batch<RPCTC, MESSAGE_T>(const_cast<MESSAGE_T&>(*held), obj);
+    }, key);
+}
+
+
+
+template <
+    typename RPCTC,
+    typename MESSAGE_T
+>
+void Transceiver::execute_rpc_batch(MESSAGE_T& msg, typename RPCTC::o_type* obj)
+{
+    using base_rpctc = typename RPCTC::base;
+    using r_type = typename unvoid<typename RPCTC::r_type>::type;
 
-    // allocate string and copy exception information
-    auto asacei = [](const char* e_what) -> const char*
+    const typename MESSAGE_T::body_type& body = msg;
+    vector<typename RPCTC::tuple_type> calls = at_c<0>(body);
+
+    r_type results;
+    try {
+        auto call = [obj](const auto&... args) { return (obj->*base_rpctc::mf())(args...); };
+        if constexpr (std::is_void_v<typename base_rpctc::r_type>) {
+            for (auto& c : calls) {
+                std::apply(call, c);
+            }
+        }
+        else {
+            results.reserve(calls.size());
+            for (auto& c : calls) {
+                results.push_back(std::apply(call, c));
+            }
+        }
+    }
+    catch(...) {
+        string what;
+        auto etid = rpc_exception_type_id(std::current_exception(), what);
+        write_rpc_reply<RPCTC>(obj, msg.sender_instance_id, msg.function_instance_id,
+            msg.message_type_id, (const r_type*)nullptr, etid, what);
+        return;
+    }
+
+    write_rpc_reply<RPCTC>(obj, msg.sender_instance_id, msg.function_instance_id,
+        msg.message_type_id, &results, not_defined_type_id, string());
+}
+
+
+
+template <
+    typename RPCTC,
+    typename MESSAGE_T
+>
+void Transceiver::rpc_stream_handler(Message_prefix& untyped_msg)
+{
+    MESSAGE_T& msg = (MESSAGE_T&)untyped_msg;
+    typename RPCTC::o_type* obj = get_instance_to_object_map<RPCTC>()[untyped_msg.receiver_instance_id];
+
+    Executor* executor = obj->m_rpc_executor;
+    if (!executor) {
+        execute_rpc_stream<RPCTC, MESSAGE_T>(msg, obj);
+        return;
+    }
+
+    // the reader moves on, thus the message must be kept for the executor
+    auto held = hold(msg);
+    auto key = obj->m_rpc_ordered ? msg.sender_instance_id : 0;
+    executor->post([held, obj]() {
+        execute_rpc_stream<RPCTC, MESSAGE_T>(const_cast<MESSAGE_T&>(*held), obj);
+    }, key);
+}
+
+
+
+template <
+    typename RPCTC,
+    typename MESSAGE_T
+>
+void Transceiver::execute_rpc_stream(MESSAGE_T& msg, typename RPCTC::o_type* obj)
+{
+    using item_type = typename RPCTC::r_type::value_type;
+    using item_message_type = Message<Enclosure<item_type>, void, not_defined_type_id>;
+    static auto once = item_message_type::id();
+    (void)(once); // suppress unused variable warning
+
+    auto caller_iid = msg.sender_instance_id;
+    auto function_iid = msg.function_instance_id;
+
+    // The writes refer to the Transceiver, rather than the object, since the object is already
+    // destroyed when an abandoned stream is failed (see destroy()).
+    const Transceiver* callee = obj;
+    auto write_exception = [callee, caller_iid, function_iid](type_id_type etid, const string& what) {
+        exception* placed_msg = s_mproc->m_out_rep_c->write<exception>(vb_size(what), what);
+        finalize_rpc_write(placed_msg, caller_iid, function_iid, callee, etid);
+    };
+
+    stream<item_type> items;
+    try {
+        items = call_function_with_fusion_vector_args(*obj, RPCTC::mf(), msg);
+    }
+    catch(...) {
+        string what;
+        auto etid = rpc_exception_type_id(std::current_exception(), what);
+        write_exception(etid, what);
+        return;
+    }
+
+    auto os = std::make_shared<Outgoing_rpc_stream>();
+    os->caller_iid   = caller_iid;
+    os->function_iid = function_iid;
+    os->callee_iid   = obj->m_instance_id;
+
+    os->write_next = [items = std::move(items), write_exception, callee, caller_iid, function_iid]()
+        mutable
     {
-        char* what = 0;
-        size_t what_size = strlen(e_what)+1;
-        what = new char[what_size];
-        strncpy_s(what, what_size, e_what, what_size);
-        return what;
+        std::optional<item_type> v;
+        try {
+            v = items.next();
+        }
+        catch(...) {
+            string what;
+            auto etid = rpc_exception_type_id(std::current_exception(), what);
+            write_exception(etid, what);
+            return false;
+        }
+
+        if (!v) {
+            // the end is written as an exception of a reserved type, which the caller expects
+            write_exception((type_id_type)detail::reserved_id::rpc_stream_end, string());
+            return false;
+        }
+
+        item_message_type* placed_msg =
+            s_mproc->m_out_rep_c->write<item_message_type>(vb_size(*v), *v);
+        finalize_rpc_write(placed_msg, caller_iid, function_iid, callee, not_defined_type_id);
+        return true;
     };
 
-    auto vf = Void_filter<r_type>{
-        [&](){return call_function_with_fusion_vector_args(*obj, RPCTC::mf(), msg);}
+    os->write_failure = [write_exception](const string& what) {
+        write_exception((type_id_type)detail::reserved_id::std_runtime_error, what);
     };
 
-    try {
-        vf.call();
+    {
+        lock_guard<mutex> lock(s_mproc->m_rpc_streams_mutex);
+        s_mproc->m_rpc_streams[{caller_iid, function_iid}] = os;
     }
-    catch(std::pair<deferral, function<void()> > &d) {
 
-        // The point for returning a function in addition to the deferral, is that
-        // we would most likely have to synchronize with the actual return, in order
-        // to prevent that the final result is written before the deferral.
-        // The function, in this case, would unlock a mutex (which is the case for
-        // the barrier implementation), or something similar.
+    pump_rpc_stream(os);
+}
 
-        deferral* placed_msg = s_mproc->m_out_rep_c->write<deferral>(0, d.first);
-        finalize_rpc_write(placed_msg, msg, obj, (type_id_type)detail::reserved_id::deferral);
-        d.second();
-        return;
+
+
+inline
+void Transceiver::pump_rpc_stream(const shared_ptr<Outgoing_rpc_stream>& os)
+{
+    {
+        lock_guard<mutex> lock(os->m);
+        while (!os->finished && os->credit) {
+            os->credit--;
+            if (!os->write_next()) {
+                os->finished = true;
+            }
+        }
+
+        // either waiting for credit, or already released (i.e. cancelled or abandoned)
+        if (!os->finished || !os->write_next) {
+            return;
+        }
+
+        // released here, rather than with the last reference, since they may refer to the callee
+        os->write_next = nullptr;
+        os->write_failure = nullptr;
     }
-    catch(std::invalid_argument  &e) { etid = (type_id_type)detail::reserved_id::std_invalid_argument; what = asacei(e.what()); }
-    catch(std::domain_error      &e) { etid = (type_id_type)detail::reserved_id::std_domain_error;     what = asacei(e.what()); }
-    catch(std::length_error      &e) { etid = (type_id_type)detail::reserved_id::std_length_error;     what = asacei(e.what()); }
-    catch(std::out_of_range      &e) { etid = (type_id_type)detail::reserved_id::std_out_of_range;     what = asacei(e.what()); }
-    catch(std::range_error       &e) { etid = (type_id_type)detail::reserved_id::std_range_error;      what = asacei(e.what()); }
-    catch(std::overflow_error    &e) { etid = (type_id_type)detail::reserved_id::std_overflow_error;   what = asacei(e.what()); }
-    catch(std::underflow_error   &e) { etid = (type_id_type)detail::reserved_id::std_underflow_error;  what = asacei(e.what()); }
-    catch(std::ios_base::failure &e) { etid = (type_id_type)detail::reserved_id::std_ios_base_failure; what = asacei(e.what()); }
-    catch(std::logic_error       &e) { etid = (type_id_type)detail::reserved_id::std_logic_error;      what = asacei(e.what()); }
-    catch(std::runtime_error     &e) { etid = (type_id_type)detail::reserved_id::std_runtime_error;    what = asacei(e.what()); }
-    catch(std::exception         &e) { etid = (type_id_type)detail::reserved_id::std_exception;        what = asacei(e.what()); }
-    catch(...)                       { etid = (type_id_type)detail::reserved_id::unknown_exception;    what = asacei(
-        "An exception was thrown whose type is not serialized by sintra");
+
+    lock_guard<mutex> lock(s_mproc->m_rpc_streams_mutex);
+    auto it = s_mproc->m_rpc_streams.find({os->caller_iid, os->function_iid});
+    if (it != s_mproc->m_rpc_streams.end() && it->second == os) {
+        s_mproc->m_rpc_streams.erase(it);
     }
+}
+
 
-    if (etid == not_defined_type_id) { // normal return
 
-        // additional return recipients, assumed to be waiting
-        if (s_tl_common_function_iid != invalid_instance_id) {
+inline
+void Transceiver::oneway_rpc_failure_handler(Message_prefix& m)
+{
+    // Delivered to the handlers of this process only, with the same sender matching as
+    // any other event.
+    Handler_dispatch::Read_guard snapshot(s_mproc->m_handler_dispatch);
+
+    auto record = snapshot->find(m.message_type_id);
+    if (!record) {
+        return;
+    }
+
+    const auto any_sender =
+        process_of(m.sender_instance_id) == s_mproc_id ? any_local : any_remote;
 
-            // NOTE: For the recipients in this loop, this will be the second time the function returns,
-            // assuming they have already received a deferral.
-            for (size_t i = 0; i < s_tl_additional_piids_size; i++) {
-                return_message_type* placed_msg = s_mproc->m_out_rep_c->write<return_message_type>(vb_size(vf.result), vf.result);
-                finalize_rpc_write(placed_msg, s_tl_additional_piids[i], s_tl_common_function_iid, obj, not_defined_type_id);
+    for (auto& e : *record) {
+        if (e.sender == m.sender_instance_id ||
+            e.sender == any_sender ||
+            e.sender == any_local_or_remote)
+        {
+            if (e.handler) {
+                e.handler(m);
             }
+            else {
+                Message_prefix* batch[] = {&m};
+                e.batch_handler(batch, 1);
+            }
+        }
+    }
+}
+
+
 
-            s_tl_additional_piids_size = 0;
-            s_tl_common_function_iid = invalid_instance_id;
+inline
+void Transceiver::rpc_stream_credit_handler(Message_prefix& untyped_msg)
+{
+    const auto& msg = (const rpc_stream_credit&)untyped_msg;
+
+    shared_ptr<Outgoing_rpc_stream> os;
+    {
+        lock_guard<mutex> lock(s_mproc->m_rpc_streams_mutex);
+        auto it = s_mproc->m_rpc_streams.find({msg.sender_instance_id, msg.function_instance_id});
+        if (it == s_mproc->m_rpc_streams.end()) {
+            // the stream has already ended
+            return;
         }
+        os = it->second;
+        if (!msg.credit) {
+            s_mproc->m_rpc_streams.erase(it);
+        }
+    }
+
+    if (!msg.credit) {
+        // cancelled by the caller, which expects nothing more
+        lock_guard<mutex> lock(os->m);
+        os->finished = true;
+        os->write_next = nullptr;
+        os->write_failure = nullptr;
+        return;
+    }
+
+    Executor* executor = nullptr;
+    uint64_t key = 0;
+    auto it = s_mproc->m_local_pointer_of_instance_id.find(os->callee_iid);
+    if (it != s_mproc->m_local_pointer_of_instance_id.end()) {
+        executor = it->second->m_rpc_executor;
+        key = it->second->m_rpc_ordered ? os->caller_iid : 0;
+    }
+
+    {
+        lock_guard<mutex> lock(os->m);
+        os->credit += msg.credit;
+    }
+
+    // the stream is pulled where the call was handled
+    if (executor) {
+        executor->post([os]() { pump_rpc_stream(os); }, key);
+    }
+    else {
+        pump_rpc_stream(os);
+    }
+}
+
 
-        // the normal return
-        return_message_type* placed_msg = s_mproc->m_out_rep_c->write<return_message_type>(vb_size(vf.result), vf.result);
-        finalize_rpc_write(placed_msg, msg, obj, etid);
+
+template <typename RPCTC, typename... Args>
+typename RPCTC::r_type
+Transceiver::call_directly(typename RPCTC::o_type* obj, const Args&... args)
+{
+    if constexpr (undeferred<typename RPCTC::mf_r_type>::is_deferred) {
+        return (obj->*RPCTC::mf())(args...).get();
     }
     else {
-        exception* placed_msg = s_mproc->m_out_rep_c->write<exception>(vb_size(string(what)), string(what));
-        finalize_rpc_write(placed_msg, msg, obj, etid);
-        delete [] what;
+        return (obj->*RPCTC::mf())(args...);
     }
 }
 
@@ -598,12 +1019,13 @@ template <
     typename... FArgs,      // The argument types of the exported member function
     typename... RArgs       // The argument types used by the caller
 >
-RT Transceiver::rpc(
+typename RPCTC::r_type
+Transceiver::rpc(
     RT(OBJECT_T::* /*resolution dummy arg*/)(FArgs...),
     instance_id_type instance_id,
     RArgs&&... args)
 {
-    using message_type = Message<unique_message_body<RPCTC, FArgs...>, RT, RPCTC::id>;
+    using message_type = Message<unique_message_body<RPCTC, FArgs...>, typename RPCTC::r_type, RPCTC::id>;
     return rpc_impl<RPCTC, message_type, FArgs...>(instance_id, args...);
 }
 
@@ -616,12 +1038,13 @@ template <
     typename... FArgs,
     typename... RArgs
 >
-RT Transceiver::rpc(
+typename RPCTC::r_type
+Transceiver::rpc(
     RT(OBJECT_T::* /*resolution_dummy arg*/)(FArgs...) const,
     instance_id_type instance_id,
     RArgs&&... args)
 {
-    using message_type = Message<unique_message_body<RPCTC, FArgs...>, RT, RPCTC::id>;
+    using message_type = Message<unique_message_body<RPCTC, FArgs...>, typename RPCTC::r_type, RPCTC::id>;
     return rpc_impl<RPCTC, message_type, FArgs...>(instance_id, args...);
 }
 
@@ -639,67 +1062,79 @@ Transceiver::rpc_impl(instance_id_type instance_id, Args... args)
         throw std::runtime_error("Attempted to make an RPC call using an invalid instance ID.");
     }
 
-    if (RPCTC::may_be_called_directly && is_local_instance(instance_id)) {
-        // if the instance is local, then it has already been registered in the instance_map
-        // of this particular type. this will only find the object and call it.
-        auto it = get_instance_to_object_map<RPCTC>().find(instance_id);
-        assert(it != get_instance_to_object_map<RPCTC>().end());
-        return (it->second->*RPCTC::mf())(args...);
+    if constexpr (RPCTC::may_be_called_directly) {
+        if (is_local_instance(instance_id)) {
+            // if the instance is local, then it has already been registered in the instance_map
+            // of this particular type. this will only find the object and call it.
+            auto it = get_instance_to_object_map<RPCTC>().find(instance_id);
+            assert(it != get_instance_to_object_map<RPCTC>().end());
+            return call_directly<RPCTC>(it->second, args...);
+        }
     }
 
     using return_type = typename MESSAGE_T::return_type;
     using return_message_type = Message<Enclosure<return_type>, void, not_defined_type_id>;
 
-    Outstanding_rpc_control orpcc;
-    orpcc.remote_instance = instance_id;
-    Unserialized_Enclosure<return_type> rm_body;
-    
-    type_id_type ex_tid = not_defined_type_id;
-    std::string ex_what;
+    // The state of the call lives on the stack of the caller. Its handlers may still be
+    // running after the call has given up waiting (e.g. on timeout), but deactivating them
+    // waits until they return. Replies that arrive after that are ignored.
+    struct Sync_rpc: Outstanding_rpc_control
+    {
+        Unserialized_Enclosure<return_type> rm_body;
+        type_id_type                        ex_tid                  = not_defined_type_id;
+        std::string                         ex_what;
+        bool                                timed_out               = false;
+    };
 
-    instance_id_type function_instance_id = invalid_instance_id;
+    Sync_rpc orpcc;
 
     Return_handler rh;
-    rh.return_handler = [&] (const Message_prefix& msg) {
+    rh.return_handler = [] (void* context, const Message_prefix& msg) {
+        auto state = (Sync_rpc*)context;
         const auto& returned_message = (const return_message_type&)(msg);
-        lock_guard<mutex> sl(orpcc.keep_waiting_mutex);
-        rm_body = returned_message;
-        orpcc.success = true;
-        orpcc.keep_waiting = false;
-        orpcc.keep_waiting_condition.notify_all();
+        lock_guard<mutex> sl(state->keep_waiting_mutex);
+        if (!state->keep_waiting) {
+            return;
+        }
+        state->rm_body = returned_message;
+        state->success = true;
+        state->keep_waiting = false;
+        state->completed = true;
+        state->keep_waiting_condition.notify_all();
     };
-    rh.exception_handler = [&] (const Message_prefix& msg) {
+    rh.exception_handler = [] (void* context, const Message_prefix& msg) {
+        auto state = (Sync_rpc*)context;
         const auto& returned_message = (const exception&)(msg);
-        lock_guard<mutex> sl(orpcc.keep_waiting_mutex);
-        orpcc.success = false;
-        ex_tid = returned_message.exception_type_id;
-        ex_what = returned_message.what;
-        orpcc.keep_waiting = false;
-        orpcc.keep_waiting_condition.notify_all();
+        lock_guard<mutex> sl(state->keep_waiting_mutex);
+        if (!state->keep_waiting) {
+            return;
+        }
+        state->success = false;
+        state->ex_tid = returned_message.exception_type_id;
+        state->ex_what = returned_message.what;
+        state->keep_waiting = false;
+        state->completed = true;
+        state->keep_waiting_condition.notify_all();
     };
-    rh.deferral_handler = [&] (const Message_prefix& msg) {
-
-        const auto& returned_message = (const deferral&)(msg);
-        lock_guard<mutex> sl(orpcc.keep_waiting_mutex);
-        // the 'success' variable here is irrelevant
-
-        // if the new_id differs, then replace it
-        assert(returned_message.new_fiid != function_instance_id);
-        s_mproc->replace_return_handler_id(function_instance_id, returned_message.new_fiid);
-        //}
-
-        // replaces the placement of the handler (message instance id)
-        // with the one received by the remote call
-        // and keeps waiting until the final result arrives,
-        // which will be identified with the replaced message instance id
+    rh.abort_handler = [] (void* context) {
+        auto state = (Sync_rpc*)context;
+        lock_guard<mutex> sl(state->keep_waiting_mutex);
+        if (!state->keep_waiting) {
+            return;
+        }
+        state->success = false;
+        state->keep_waiting = false;
+        state->completed = true;
+        state->keep_waiting_condition.notify_one();
     };
+    rh.context = &orpcc;
+    rh.instance_id = instance_id;
 
 
     // block until reading thread either receives results or the call fails
     unique_lock<mutex> sl(orpcc.keep_waiting_mutex);
 
-    rh.instance_id = instance_id;
-    function_instance_id = s_mproc->activate_return_handler(rh);
+    auto function_instance_id = s_mproc->activate_return_handler(rh);
 
 
     // write the message for the rpc call into the communication ring
@@ -711,93 +1146,776 @@ Transceiver::rpc_impl(instance_id_type instance_id, Args... args)
     msg->function_instance_id = function_instance_id;
     s_mproc->m_out_req_c->done_writing();
 
-    {
-        unique_lock<mutex> orpclock(s_outstanding_rpcs_mutex);
-        s_outstanding_rpcs.insert(&orpcc);
+    // The reply is read by the reply reader, which would have to wake this thread up, unless
+    // it is spinning. The lock is released meanwhile, for the return handler to proceed.
+    auto spin_period = s_rpc_spin_period.load();
+    if (spin_period > 0.) {
+        sl.unlock();
+        double tl = get_wtime() + spin_period;
+        while (!orpcc.completed.load() && get_wtime() < tl) {}
+        sl.lock();
     }
 
-    //    _       .//'
-    //   (_).  .//'                          TODO: for an asynchronous implementation, cut here
-    // -- _  O|| --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --  --
-    //   (_)'  '\\.
-    //            '\\.
+    // If a process supplying results crashes, the call is unblocked by unblock_rpc(), once the
+    // coordinator notices. If it blocks, only a timeout will unblock it (see Rpc_timeout).
+    auto timeout = Rpc_timeout::current();
+    auto deadline = std::chrono::steady_clock::now() +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(timeout));
 
     while (orpcc.keep_waiting) {
-        // TODO: FIXME
-        // If one of the processes supplying results crashes without notice or blocks,
-        // this will deadlock. We need to put a time limit, implement recovery and test it.
-        // use wait_for, rather than wait - but not just yet -
+        if (timeout <= 0) {
+            orpcc.keep_waiting_condition.wait(sl);
+        }
+        else
+        if (orpcc.keep_waiting_condition.wait_until(sl, deadline) == std::cv_status::timeout &&
+            orpcc.keep_waiting)
+        {
+            orpcc.success = false;
+            orpcc.timed_out = true;
+            orpcc.keep_waiting = false;
+        }
+    }
+    sl.unlock();
 
-        //1. put the mutex in a process wide mutex list
-        //2. the condition in the while should also check for thread termination
-        //3. wait_for
+    // we can now disable the return message handler. Once this returns, no handler refers to
+    // orpcc any more.
+    s_mproc->deactivate_return_handler(function_instance_id);
+
+    if (!orpcc.success) {
+        if (orpcc.timed_out) {
+            throw rpc_timeout_exception();
+        }
+        else
+        if (orpcc.ex_tid != not_defined_type_id) {
+            // interprocess exception
+            string_to_exception(orpcc.ex_tid, orpcc.ex_what);
+        }
+        else {
+            // rpc failure
+            throw std::runtime_error("RPC failed");
+        }
+    }
+
+    return orpcc.rm_body.get_value();
+}
 
-        // if it fails throw exception.
 
 
-        orpcc.keep_waiting_condition.wait(sl);
+template <
+    typename RPCTC,
+    typename RT,
+    typename OBJECT_T,
+    typename... FArgs,
+    typename... RArgs
+>
+instance_id_type Transceiver::rpc_async(
+    RT(OBJECT_T::* /*resolution dummy arg*/)(FArgs...),
+    Rpc_completion<typename RPCTC::r_type> completion,
+    instance_id_type instance_id,
+    RArgs&&... args)
+{
+    using message_type = Message<unique_message_body<RPCTC, FArgs...>, typename RPCTC::r_type, RPCTC::id>;
+    return rpc_async_impl<RPCTC, message_type, FArgs...>(instance_id, std::move(completion), args...);
+}
+
+
+
+template <
+    typename RPCTC,
+    typename RT,
+    typename OBJECT_T,
+    typename... FArgs,
+    typename... RArgs
+>
+instance_id_type Transceiver::rpc_async(
+    RT(OBJECT_T::* /*resolution dummy arg*/)(FArgs...) const,
+    Rpc_completion<typename RPCTC::r_type> completion,
+    instance_id_type instance_id,
+    RArgs&&... args)
+{
+    using message_type = Message<unique_message_body<RPCTC, FArgs...>, typename RPCTC::r_type, RPCTC::id>;
+    return rpc_async_impl<RPCTC, message_type, FArgs...>(instance_id, std::move(completion), args...);
+}
+
+
+
+template <
+    typename RPCTC,
+    typename MESSAGE_T,
+    typename... Args
+>
+instance_id_type Transceiver::rpc_async_impl(
+    instance_id_type instance_id,
+    Rpc_completion<typename RPCTC::r_type> completion,
+    Args... args)
+{
+    using r_type = typename RPCTC::r_type;
+
+    if (instance_id == invalid_instance_id) {
+        throw std::runtime_error("Attempted to make an RPC call using an invalid instance ID.");
     }
 
-    {
-        unique_lock<mutex> orpclock(s_outstanding_rpcs_mutex);
-        s_outstanding_rpcs.erase(&orpcc);
+    if (RPCTC::may_be_called_directly && is_local_instance(instance_id)) {
+        auto it = get_instance_to_object_map<RPCTC>().find(instance_id);
+        assert(it != get_instance_to_object_map<RPCTC>().end());
+
+        // the completion is called outside the try block, thus it is called only once
+        std::exception_ptr ep;
+        if constexpr (std::is_void_v<r_type>) {
+            try { (it->second->*RPCTC::mf())(args...); }
+            catch (...) { ep = std::current_exception(); }
+            if (!ep) {
+                completion.on_return();
+            }
+        }
+        else
+        if constexpr (undeferred<typename RPCTC::mf_r_type>::is_deferred) {
+
+            // the completion is forwarded to the token, rather than waited for, thus the call
+            // remains asynchronous, whichever thread completes it
+            std::optional<typename RPCTC::mf_r_type> token;
+            try { token.emplace((it->second->*RPCTC::mf())(args...)); }
+            catch (...) { ep = std::current_exception(); }
+            if (!ep) {
+                token->on_completion(
+                    [completion = std::move(completion)](const r_type* value, std::exception_ptr e)
+                {
+                    if (value) {
+                        completion.on_return(*value);
+                    }
+                    else {
+                        completion.on_failure(e);
+                    }
+                });
+                return invalid_instance_id;
+            }
+        }
+        else {
+            std::optional<r_type> result;
+            try { result.emplace(call_directly<RPCTC>(it->second, args...)); }
+            catch (...) { ep = std::current_exception(); }
+            if (!ep) {
+                completion.on_return(std::move(*result));
+            }
+        }
+        if (ep) {
+            completion.on_failure(ep);
+        }
+        return invalid_instance_id;
     }
 
+    using return_type = typename MESSAGE_T::return_type;
+    using return_message_type = Message<Enclosure<return_type>, void, not_defined_type_id>;
 
-    sl.unlock();
+    // The state of the call is owned by its return handlers, which outlive this function.
+    // Whichever of the reply and the abort comes first completes the call and deletes it.
+    struct Async_rpc: Outstanding_rpc_control
+    {
+        Rpc_completion<r_type>  completion;
+        instance_id_type        function_instance_id = invalid_instance_id;
+
+        // Returns true only for the first outcome. It is called from a handler of the call,
+        // thus the deactivation only waits for handlers running on other threads, which may
+        // still access the state.
+        bool finish()
+        {
+            {
+                lock_guard<mutex> sl(keep_waiting_mutex);
+                if (!keep_waiting) {
+                    return false;
+                }
+                keep_waiting = false;
+            }
 
-    // we can now disable the return message handler
-    s_mproc->deactivate_return_handler(function_instance_id);
+            s_mproc->deactivate_return_handler(function_instance_id);
+            return true;
+        }
+    };
 
-    if (!orpcc.success) {
-        if (ex_tid != not_defined_type_id) {
-            // interprocess exception
-            string_to_exception(ex_tid, ex_what);
+    auto state = new Async_rpc;
+    state->completion = std::move(completion);
+
+    Return_handler rh;
+    rh.return_handler = [] (void* context, const Message_prefix& msg) {
+        auto state = (Async_rpc*)context;
+        if (!state->finish()) {
+            return;
+        }
+        std::unique_ptr<Async_rpc> owner(state);
+        Unserialized_Enclosure<return_type> rm_body;
+        rm_body = (const return_message_type&)(msg);
+        if constexpr (std::is_void_v<r_type>) {
+            state->completion.on_return();
         }
         else {
-            // rpc failure
-            throw std::runtime_error("RPC failed");
+            state->completion.on_return(rm_body.get_value());
+        }
+    };
+    rh.exception_handler = [] (void* context, const Message_prefix& msg) {
+        auto state = (Async_rpc*)context;
+        const auto& returned_message = (const exception&)(msg);
+        auto ex_tid = returned_message.exception_type_id;
+        string ex_what = returned_message.what;
+        if (!state->finish()) {
+            return;
+        }
+        std::unique_ptr<Async_rpc> owner(state);
+
+        std::exception_ptr ep;
+        try { string_to_exception(ex_tid, ex_what); }
+        catch (...) { ep = std::current_exception(); }
+        if (!ep) {
+            ep = std::make_exception_ptr(std::runtime_error("RPC failed"));
         }
+        state->completion.on_failure(ep);
+    };
+    rh.abort_handler = [] (void* context) {
+        auto state = (Async_rpc*)context;
+        if (!state->finish()) {
+            return;
+        }
+        std::unique_ptr<Async_rpc> owner(state);
+        state->completion.on_failure(
+            std::make_exception_ptr(std::runtime_error("RPC failed")));
+    };
+    rh.context = state;
+    rh.instance_id = instance_id;
+
+    // The handler may be called as soon as it is activated (e.g. by unblock_rpc()), after
+    // which the state may no longer be accessed here.
+    instance_id_type function_instance_id;
+    {
+        lock_guard<mutex> sl(state->keep_waiting_mutex);
+        function_instance_id = state->function_instance_id = s_mproc->activate_return_handler(rh);
+    }
+
+    static auto once = MESSAGE_T::id();
+    (void)(once); // suppress unused variable warning
+    MESSAGE_T* msg = s_mproc->m_out_req_c->write<MESSAGE_T>(vb_size(args...), args...);
+    msg->sender_instance_id = s_mproc->m_instance_id;
+    msg->receiver_instance_id = instance_id;
+    msg->function_instance_id = function_instance_id;
+    s_mproc->m_out_req_c->done_writing();
+    return function_instance_id;
+}
+
+
+
+template <
+    typename RPCTC,
+    typename RT,
+    typename OBJECT_T,
+    typename... FArgs,
+    typename... RArgs
+>
+void Transceiver::rpc_oneway(
+    RT(OBJECT_T::* /*resolution dummy arg*/)(FArgs...),
+    instance_id_type instance_id,
+    RArgs&&... args)
+{
+    using message_type = Message<unique_message_body<RPCTC, FArgs...>, typename RPCTC::r_type, RPCTC::id>;
+    rpc_oneway_impl<RPCTC, message_type, FArgs...>(instance_id, args...);
+}
+
+
+
+template <
+    typename RPCTC,
+    typename RT,
+    typename OBJECT_T,
+    typename... FArgs,
+    typename... RArgs
+>
+void Transceiver::rpc_oneway(
+    RT(OBJECT_T::* /*resolution dummy arg*/)(FArgs...) const,
+    instance_id_type instance_id,
+    RArgs&&... args)
+{
+    using message_type = Message<unique_message_body<RPCTC, FArgs...>, typename RPCTC::r_type, RPCTC::id>;
+    rpc_oneway_impl<RPCTC, message_type, FArgs...>(instance_id, args...);
+}
+
+
+
+template <
+    typename RPCTC,
+    typename MESSAGE_T,
+    typename... Args
+>
+void Transceiver::rpc_oneway_impl(instance_id_type instance_id, Args... args)
+{
+    if (instance_id == invalid_instance_id) {
+        throw std::runtime_error("Attempted to make an RPC call using an invalid instance ID.");
     }
 
-    return rm_body.get_value();
+    if (RPCTC::may_be_called_directly && is_local_instance(instance_id)) {
+        auto it = get_instance_to_object_map<RPCTC>().find(instance_id);
+        assert(it != get_instance_to_object_map<RPCTC>().end());
+        (it->second->*RPCTC::mf())(args...);
+        return;
+    }
+
+    // the invalid function instance id is what tells the callee not to reply
+    static auto once = MESSAGE_T::id();
+    (void)(once); // suppress unused variable warning
+
+    // failures are addressed to the process of the caller (see write_rpc_reply())
+    static auto once_failure =
+        get_rpc_handler_map()[(type_id_type)detail::reserved_id::oneway_rpc_failure] =
+        &Transceiver::oneway_rpc_failure_handler;
+    (void)(once_failure); // suppress unused variable warning
+    MESSAGE_T* msg = s_mproc->m_out_req_c->write<MESSAGE_T>(vb_size(args...), args...);
+    msg->sender_instance_id = s_mproc->m_instance_id;
+    msg->receiver_instance_id = instance_id;
+    msg->function_instance_id = invalid_instance_id;
+    s_mproc->m_out_req_c->done_writing();
+}
+
+
+
+template <
+    typename RPCTC,
+    typename RT,
+    typename OBJECT_T,
+    typename... FArgs,
+    typename... RArgs
+>
+Rpc_stream<typename RT::value_type> Transceiver::rpc_stream(
+    RT(OBJECT_T::* /*resolution dummy arg*/)(FArgs...),
+    instance_id_type instance_id,
+    RArgs&&... args)
+{
+    using message_type = Message<unique_message_body<RPCTC, FArgs...>, typename RPCTC::r_type, RPCTC::id>;
+    return rpc_stream_impl<RPCTC, message_type, FArgs...>(instance_id, args...);
+}
+
+
+
+template <
+    typename RPCTC,
+    typename RT,
+    typename OBJECT_T,
+    typename... FArgs,
+    typename... RArgs
+>
+Rpc_stream<typename RT::value_type> Transceiver::rpc_stream(
+    RT(OBJECT_T::* /*resolution dummy arg*/)(FArgs...) const,
+    instance_id_type instance_id,
+    RArgs&&... args)
+{
+    using message_type = Message<unique_message_body<RPCTC, FArgs...>, typename RPCTC::r_type, RPCTC::id>;
+    return rpc_stream_impl<RPCTC, message_type, FArgs...>(instance_id, args...);
+}
+
+
+
+template <
+    typename RPCTC,
+    typename MESSAGE_T,
+    typename... Args
+>
+Rpc_stream<typename RPCTC::r_type::value_type>
+Transceiver::rpc_stream_impl(instance_id_type instance_id, Args... args)
+{
+    using item_type = typename RPCTC::r_type::value_type;
+    using item_message_type = Message<Enclosure<item_type>, void, not_defined_type_id>;
+    using state_type = typename Rpc_stream<item_type>::State;
+
+    if (instance_id == invalid_instance_id) {
+        throw std::runtime_error("Attempted to make an RPC call using an invalid instance ID.");
+    }
+
+    // The state is on the heap, thus it does not move with the stream. The handlers are
+    // deactivated by close(), before it is released.
+    Rpc_stream<item_type> ret;
+    auto state = ret.m_state.get();
+    state->callee_iid = instance_id;
+
+    Return_handler rh;
+    rh.return_handler = [] (void* context, const Message_prefix& msg) {
+        auto state = (state_type*)context;
+        Unserialized_Enclosure<item_type> item;
+        item = (const item_message_type&)(msg);
+        lock_guard<mutex> sl(state->m);
+        if (state->ended) {
+            return;
+        }
+        state->items.push_back(item.get_value());
+        state->cv.notify_one();
+    };
+    rh.exception_handler = [] (void* context, const Message_prefix& msg) {
+        auto state = (state_type*)context;
+        const auto& returned_message = (const exception&)(msg);
+        lock_guard<mutex> sl(state->m);
+        if (state->ended) {
+            return;
+        }
+        if (returned_message.exception_type_id != (type_id_type)detail::reserved_id::rpc_stream_end) {
+            state->ex_tid = returned_message.exception_type_id;
+            state->ex_what = returned_message.what;
+        }
+        state->ended = true;
+        state->cv.notify_one();
+    };
+    rh.abort_handler = [] (void* context) {
+        auto state = (state_type*)context;
+        lock_guard<mutex> sl(state->m);
+        if (state->ended) {
+            return;
+        }
+        state->aborted = true;
+        state->ended = true;
+        state->cv.notify_one();
+    };
+    rh.context = state;
+    rh.instance_id = instance_id;
+
+    state->function_iid = s_mproc->activate_return_handler(rh);
+
+    static auto once = MESSAGE_T::id();
+    (void)(once); // suppress unused variable warning
+    MESSAGE_T* msg = s_mproc->m_out_req_c->write<MESSAGE_T>(vb_size(args...), args...);
+    msg->sender_instance_id = s_mproc->m_instance_id;
+    msg->receiver_instance_id = instance_id;
+    msg->function_instance_id = state->function_iid;
+    s_mproc->m_out_req_c->done_writing();
+
+    return ret;
 }
 
 
 
 inline
-instance_id_type
-Transceiver::activate_return_handler(const Return_handler &rh)
+void Transceiver::grant_rpc_stream_credit(
+    instance_id_type callee_iid,
+    instance_id_type function_iid,
+    uint32_t credit)
 {
-    instance_id_type function_instance_id = make_instance_id();
-    lock_guard<mutex> sl(m_return_handlers_mutex);
-    m_active_return_handlers[function_instance_id] = rh;
-    return function_instance_id;
+    // addressed to the process of the callee, which outlives the callee
+    rpc_stream_credit* msg = s_mproc->m_out_req_c->write<rpc_stream_credit>(0, credit);
+    msg->sender_instance_id = s_mproc->m_instance_id;
+    msg->receiver_instance_id = process_of(callee_iid);
+    msg->function_instance_id = function_iid;
+    s_mproc->m_out_req_c->done_writing();
+}
+
+
+
+template <typename T>
+bool Rpc_stream<T>::next(T& value)
+{
+    auto& st = *m_state;
+    unique_lock<mutex> lock(st.m);
+
+    auto available = [&]() { return !st.items.empty() || st.ended; };
+    auto timeout = Rpc_timeout::current();
+    if (timeout <= 0) {
+        st.cv.wait(lock, available);
+    }
+    else
+    if (!st.cv.wait_for(lock, std::chrono::duration<double>(timeout), available)) {
+        st.aborted = true;
+        lock.unlock();
+        close();
+        throw rpc_timeout_exception();
+    }
+
+    if (!st.items.empty()) {
+        value = std::move(st.items.front());
+        st.items.pop_front();
+
+        // the callee is granted what was consumed, half a window at a time
+        uint32_t credit = 0;
+        if (++st.consumed == rpc_stream_window / 2) {
+            credit = st.consumed;
+            st.consumed = 0;
+        }
+        bool ended = st.ended;
+        lock.unlock();
+
+        if (credit && !ended) {
+            Transceiver::grant_rpc_stream_credit(st.callee_iid, st.function_iid, credit);
+        }
+        return true;
+    }
+    lock.unlock();
+
+    // the handlers are deactivated, thus the state is no longer modified
+    close();
+
+    if (st.ex_tid != not_defined_type_id) {
+        string_to_exception(st.ex_tid, st.ex_what);
+    }
+    if (st.aborted) {
+        throw std::runtime_error("RPC failed");
+    }
+    return false;
+}
+
+
+
+template <typename T>
+void Rpc_stream<T>::close()
+{
+    if (!m_state || m_state->released) {
+        return;
+    }
+    m_state->released = true;
+
+    // once this returns, no handler refers to the state
+    s_mproc->deactivate_return_handler(m_state->function_iid);
+
+    bool cancel = false;
+    {
+        lock_guard<mutex> lock(m_state->m);
+        if (!m_state->ended) {
+            cancel = true;
+            m_state->aborted = true;
+            m_state->ended = true;
+        }
+    }
+
+    if (cancel && s_mproc->m_state >= Managed_process::PAUSED) {
+        Transceiver::grant_rpc_stream_credit(m_state->callee_iid, m_state->function_iid, 0);
+    }
+}
+
+
+
+template <typename RPCTC>
+auto Transceiver::rpc_batch(
+    instance_id_type instance_id,
+    const vector<typename batch_of<RPCTC, typename RPCTC::mf_type>::type::tuple_type>& calls)
+    -> typename batch_of<RPCTC, typename RPCTC::mf_type>::type::r_type
+{
+    using batch_type = typename batch_of<RPCTC, typename RPCTC::mf_type>::type;
+    using message_type = Message<
+        unique_message_body<batch_type, vector<typename batch_type::tuple_type>>,
+        typename batch_type::r_type,
+        batch_type::id
+    >;
+
+    static_assert(batch_type::is_supported,
+        "Only functions with trivially copyable arguments and results can be batched.");
+
+    // a batch to a local instance is just a loop
+    if (RPCTC::may_be_called_directly && is_local_instance(instance_id)) {
+        auto it = get_instance_to_object_map<RPCTC>().find(instance_id);
+        assert(it != get_instance_to_object_map<RPCTC>().end());
+
+        auto call = [obj = it->second](const auto&... args) {
+            return (obj->*RPCTC::mf())(args...);
+        };
+        if constexpr (std::is_void_v<typename RPCTC::r_type>) {
+            for (auto& c : calls) {
+                std::apply(call, c);
+            }
+        }
+        else {
+            typename batch_type::r_type ret;
+            ret.reserve(calls.size());
+            for (auto& c : calls) {
+                ret.push_back(std::apply(call, c));
+            }
+            return ret;
+        }
+    }
+    else {
+        return rpc_impl<batch_type, message_type>(instance_id, calls);
+    }
+}
+
+
+
+template <
+    typename RPCTC,
+    typename MF,
+    typename ON_RESULT,
+    typename ON_FAILURE,
+    typename... Args
+>
+void Transceiver::rpc_scatter(
+    MF mf,
+    const vector<instance_id_type>& instances,
+    ON_RESULT on_result,
+    ON_FAILURE on_failure,
+    const Args&... args)
+{
+    using r_type = typename RPCTC::r_type;
+
+    // The completions may be called after this returns (i.e. once it times out), thus they
+    // share the state, and they only call the handlers while the caller is waiting.
+    struct Scatter_state
+    {
+        Scatter_state(size_t n, ON_RESULT&& r, ON_FAILURE&& f):
+            completed(n, false),
+            num_pending(n),
+            on_result(std::move(r)),
+            on_failure(std::move(f))
+        {}
+
+        mutex                   m;
+        condition_variable      cv;
+        vector<bool>            completed;
+        size_t                  num_pending;
+        bool                    waiting         = true;
+        ON_RESULT               on_result;
+        ON_FAILURE              on_failure;
+    };
+
+    auto state = std::make_shared<Scatter_state>(
+        instances.size(), std::move(on_result), std::move(on_failure));
+
+    // the calls of the members that time out are aborted, to release their return handlers
+    vector<instance_id_type> function_iids(instances.size(), invalid_instance_id);
+
+    // calls f, unless the member has already completed, or the caller is no longer waiting
+    auto complete = [](Scatter_state& st, size_t i, const function<void()>& f) {
+        lock_guard<mutex> lock(st.m);
+        if (!st.waiting || st.completed[i]) {
+            return;
+        }
+        st.completed[i] = true;
+        f();
+        if (--st.num_pending == 0) {
+            st.cv.notify_one();
+        }
+    };
+
+    for (size_t i = 0; i < instances.size(); i++) {
+        Rpc_completion<r_type> completion;
+        if constexpr (std::is_void_v<r_type>) {
+            completion.on_return = [state, i, complete]() {
+                complete(*state, i, [&]() { state->on_result(i); });
+            };
+        }
+        else {
+            completion.on_return = [state, i, complete](r_type v) {
+                complete(*state, i, [&]() { state->on_result(i, std::move(v)); });
+            };
+        }
+        completion.on_failure = [state, i, complete](std::exception_ptr e) {
+            complete(*state, i, [&]() { state->on_failure(i, e); });
+        };
+
+        auto on_failure_copy = completion.on_failure;
+        try {
+            function_iids[i] = rpc_async<RPCTC>(mf, std::move(completion), instances[i], args...);
+        }
+        catch (...) {
+            // e.g. an invalid instance id
+            on_failure_copy(std::current_exception());
+        }
+    }
+
+    auto timeout = Rpc_timeout::current();
+    auto deadline = std::chrono::steady_clock::now() +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(timeout));
+
+    vector<instance_id_type> timed_out;
+
+    unique_lock<mutex> lock(state->m);
+    while (state->num_pending) {
+        if (timeout <= 0) {
+            state->cv.wait(lock);
+        }
+        else
+        if (state->cv.wait_until(lock, deadline) == std::cv_status::timeout) {
+            for (size_t i = 0; i < instances.size(); i++) {
+                if (!state->completed[i]) {
+                    state->completed[i] = true;
+                    state->on_failure(i, std::make_exception_ptr(rpc_timeout_exception()));
+                    timed_out.push_back(function_iids[i]);
+                }
+            }
+            state->num_pending = 0;
+        }
+    }
+    state->waiting = false;
+    lock.unlock();
+
+    // Outside the lock, because the completions of the aborted calls take it. They are
+    // ignored, since the caller is no longer waiting.
+    for (auto fiid : timed_out) {
+        s_mproc->abort_rpc(fiid);
+    }
+}
+
+
+
+template <typename RPCTC, typename MF, typename... Args>
+auto Transceiver::rpc_gather(MF mf, const vector<instance_id_type>& instances, const Args&... args)
+    -> vector<Member_result<typename RPCTC::r_type>>
+{
+    using r_type = typename RPCTC::r_type;
+
+    // the handlers only run while rpc_scatter() is waiting, thus they may refer to ret
+    vector<Member_result<r_type>> ret(instances.size());
+    for (size_t i = 0; i < instances.size(); i++) {
+        ret[i].instance_id = instances[i];
+    }
+
+    auto on_failure = [&ret](size_t i, std::exception_ptr e) { ret[i].error = e; };
+
+    if constexpr (std::is_void_v<r_type>) {
+        rpc_scatter<RPCTC>(mf, instances, [](size_t) {}, on_failure, args...);
+    }
+    else {
+        auto on_result = [&ret](size_t i, r_type v) { ret[i].value = std::move(v); };
+        rpc_scatter<RPCTC>(mf, instances, on_result, on_failure, args...);
+    }
+    return ret;
+}
+
+
+
+template <typename RPCTC, typename MF, typename T, typename F, typename... Args>
+Rpc_reduction<T> Transceiver::rpc_reduce(
+    MF mf,
+    const vector<instance_id_type>& instances,
+    T init,
+    F reduce,
+    const Args&... args)
+{
+    using r_type = typename RPCTC::r_type;
+    static_assert(!std::is_void_v<r_type>, "A function returning void cannot be reduced.");
+
+    Rpc_reduction<T> ret{std::move(init), vector<Member_status>(instances.size())};
+    for (size_t i = 0; i < instances.size(); i++) {
+        ret.status[i].instance_id = instances[i];
+    }
+
+    // the results are reduced in the order in which they arrive
+    auto on_result = [&ret, &reduce](size_t, r_type v) {
+        ret.value = reduce(std::move(ret.value), std::move(v));
+    };
+    auto on_failure = [&ret](size_t i, std::exception_ptr e) { ret.status[i].error = e; };
+
+    rpc_scatter<RPCTC>(mf, instances, on_result, on_failure, args...);
+    return ret;
 }
 
 
 
 inline
-void
-Transceiver::deactivate_return_handler(instance_id_type function_instance_id)
+instance_id_type
+Transceiver::activate_return_handler(const Return_handler &rh)
 {
-    lock_guard<mutex> sl(m_return_handlers_mutex);
-    m_active_return_handlers.erase(function_instance_id);
+    return m_return_handlers.activate(rh);
 }
 
 
+
 inline
 void
-Transceiver::replace_return_handler_id(instance_id_type old_id, instance_id_type new_id)
+Transceiver::deactivate_return_handler(instance_id_type function_instance_id)
 {
-    lock_guard<mutex> sl(m_return_handlers_mutex);
-    auto node_handler = m_active_return_handlers.extract(old_id);
-    node_handler.key() = new_id;
-    m_active_return_handlers.insert(std::move(node_handler));
+    m_return_handlers.deactivate(function_instance_id);
 }
 
 
-
 template <typename RPCTC, typename MT>
 function<void()>
 Transceiver::export_rpc_impl()
@@ -815,16 +1933,86 @@ Transceiver::export_rpc_impl()
         &RPCTC_o_type::template rpc_handler<RPCTC, MT>;
     (void)(once); // suppress unused variable warning
 
+    // the batch handler finds the instance through the same map
+    static bool once_batch = (export_rpc_batch<RPCTC>(), true);
+    (void)(once_batch); // suppress unused variable warning
+
+    return [&] () {get_instance_to_object_map<RPCTC>().erase(m_instance_id); };
+}
+
+
+
+template <typename RPCTC>
+void
+Transceiver::export_rpc_batch()
+{
+    using batch_type = typename batch_of<RPCTC, typename RPCTC::mf_type>::type;
+
+    // Functions with reserved ids are internal, and they are exported before types can be
+    // resolved, thus they are not batched.
+    if constexpr (batch_type::is_supported && RPCTC::id == invalid_type_id) {
+        using message_type = Message<
+            unique_message_body<batch_type, vector<typename batch_type::tuple_type>>,
+            typename batch_type::r_type,
+            batch_type::id
+        >;
+
+        static auto once = get_rpc_handler_map()[message_type::id()] =
+            &Transceiver::rpc_batch_handler<batch_type, message_type>;
+        (void)(once); // suppress unused variable warning
+    }
+}
+
+
+
+template <typename RPCTC, typename MT>
+function<void()>
+Transceiver::export_rpc_stream_impl()
+{
+    warn_about_reference_args<MT>();
+
+    get_instance_to_object_map<RPCTC>()[m_instance_id] = static_cast<typename RPCTC::o_type*>(this);
+
+    static auto once = get_rpc_handler_map()[MT::id()] =
+        &Transceiver::rpc_stream_handler<RPCTC, MT>;
+    (void)(once); // suppress unused variable warning
+
+    // the credits of all the streams of the process are handled by the same handler
+    static auto once_credit =
+        get_rpc_handler_map()[(type_id_type)detail::reserved_id::rpc_stream_credit] =
+        &Transceiver::rpc_stream_credit_handler;
+    (void)(once_credit); // suppress unused variable warning
+
     return [&] () {get_instance_to_object_map<RPCTC>().erase(m_instance_id); };
 }
 
 
 
+template <typename RPCTC, typename RT, typename OBJECT_T, typename... Args>
+function<void()>
+Transceiver::export_rpc_stream(RT(OBJECT_T::* /*resolution dummy arg*/)(Args...) const)
+{
+    using message_type = Message<unique_message_body<RPCTC, Args...>, typename RPCTC::r_type, RPCTC::id>;
+    return export_rpc_stream_impl<RPCTC, message_type>();
+}
+
+
+
+template <typename RPCTC, typename RT, typename OBJECT_T, typename... Args>
+function<void()>
+Transceiver::export_rpc_stream(RT(OBJECT_T::* /*resolution dummy arg*/)(Args...))
+{
+    using message_type = Message<unique_message_body<RPCTC, Args...>, typename RPCTC::r_type, RPCTC::id>;
+    return export_rpc_stream_impl<RPCTC, message_type>();
+}
+
+
+
 template <typename RPCTC, typename RT, typename OBJECT_T, typename... Args>
 function<void()>
 Transceiver::export_rpc(RT(OBJECT_T::* /*resolution dummy arg*/)(Args...) const)
 {
-    using message_type = Message<unique_message_body<RPCTC, Args...>, RT, RPCTC::id>;
+    using message_type = Message<unique_message_body<RPCTC, Args...>, typename RPCTC::r_type, RPCTC::id>;
     return export_rpc_impl<RPCTC, message_type>();
 }
 
@@ -834,7 +2022,7 @@ template <typename RPCTC, typename RT, typename OBJECT_T, typename... Args>
 function<void()>
 Transceiver::export_rpc(RT(OBJECT_T::* /*resolution dummy arg*/)(Args...))
 {
-    using message_type = Message<unique_message_body<RPCTC, Args...>, RT, RPCTC::id>;
+    using message_type = Message<unique_message_body<RPCTC, Args...>, typename RPCTC::r_type, RPCTC::id>;
     return export_rpc_impl<RPCTC, message_type>();
 }
 
@@ -55,6 +55,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "detail/coordinator.h"
 #include "detail/coordinator_impl.h"
+#include "detail/coroutines.h"
 #include "detail/globals.h"
 #include "detail/managed_process.h"
 #include "detail/managed_process_impl.h"
@@ -72,6 +73,12 @@ template <typename ...Args>
 void start(int argc, char* argv[], const Process_descriptor& first, Args&&... rest);
 
 
+// Makes the processes of the swarm read the rings of each other directly, rather than through
+// the relay of the coordinator. It must be called before init(), in the starter process, and
+// it applies to all the processes it spawns. See s_mesh in managed_process.h
+void enable_mesh();
+
+
 // Stops all threads to allow the program to terminate.
 void stop();
 
@@ -99,6 +106,39 @@ auto activate_slot(
     Typed_instance_id<SENDER_T> sender_id = Typed_instance_id<void>(any_local_or_remote) );
 
 
+// Activates a slot taking a Message_batch, i.e. all the consecutive messages of its type that
+// are read together. See Transceiver::activate_batch()
+template <typename FT, typename SENDER_T = void>
+auto activate_batch_slot(
+    const FT& slot_function,
+    Typed_instance_id<SENDER_T> sender_id = Typed_instance_id<void>(any_local_or_remote) );
+
+
+// Sets whether events delivered within the process (i.e. to any_local, as well as the local
+// share of any_local_or_remote) are dispatched by a dedicated thread (the default), or by
+// the sending thread, before the call returns. See local_events.h
+void set_local_delivery(Local_delivery delivery);
+
+
+// Sets the time synchronous RPC calls wait for their reply, in seconds, unless they are made
+// within an Rpc_timeout scope. Zero waits indefinitely, which is the default. Barriers wait
+// indefinitely as well, unless they are in a scope.
+void set_rpc_timeout(double seconds);
+
+
+// Sets the time synchronous RPC calls spin for their reply, in seconds, before they block.
+// Spinning spares the calling thread from being woken up by the reader, which takes a context
+// switch, at the expense of a busy core. It is only meant for processes pinned to cores of
+// their own. Zero, which is the default, disables spinning.
+void set_rpc_spin_period(double seconds);
+
+
+// The published instances of the specified type, across the swarm, e.g. to be called together
+// with rpc_gather_<m> or rpc_reduce_<m>.
+template <typename T>
+vector<instance_id_type> instances_of();
+
+
 } // namespace sintra
 
 